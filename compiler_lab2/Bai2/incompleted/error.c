@@ -7,72 +7,83 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "error.h"
+#include "trace.h"
+
+#define ERROR_LINE_MAX 128
 
 void error(ErrorCode err, int lineNo, int colNo) {
+  char line[ERROR_LINE_MAX];
+  char *message = "";
+
   switch (err) {
   case ERR_ENDOFCOMMENT:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_ENDOFCOMMENT);
+    message = ERM_ENDOFCOMMENT;
     break;
   case ERR_IDENTTOOLONG:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_IDENTTOOLONG);
+    message = ERM_IDENTTOOLONG;
     break;
   case ERR_INVALIDCHARCONSTANT:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_INVALIDCHARCONSTANT);
+    message = ERM_INVALIDCHARCONSTANT;
     break;
   case ERR_INVALIDSYMBOL:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_INVALIDSYMBOL);
+    message = ERM_INVALIDSYMBOL;
     break;
   case ERR_INVALIDCONSTANT:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_INVALIDCONSTANT);
+    message = ERM_INVALIDCONSTANT;
     break;
   case ERR_INVALIDTYPE:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_INVALIDTYPE);
+    message = ERM_INVALIDTYPE;
     break;
   case ERR_INVALIDBASICTYPE:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_INVALIDBASICTYPE);
+    message = ERM_INVALIDBASICTYPE;
     break;
   case ERR_INVALIDPARAM:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_INVALIDPARAM);
+    message = ERM_INVALIDPARAM;
     break;
   case ERR_INVALIDSTATEMENT:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_INVALIDSTATEMENT);
+    message = ERM_INVALIDSTATEMENT;
     break;
   case ERR_INVALIDARGUMENTS:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_INVALIDARGUMENTS);
+    message = ERM_INVALIDARGUMENTS;
     break;
   case ERR_INVALIDCOMPARATOR:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_INVALIDCOMPARATOR);
+    message = ERM_INVALIDCOMPARATOR;
     break;
   case ERR_INVALIDEXPRESSION:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_INVALIDEXPRESSION);
+    message = ERM_INVALIDEXPRESSION;
     break;
   case ERR_INVALIDTERM:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_INVALIDTERM);
+    message = ERM_INVALIDTERM;
     break;
   case ERR_INVALIDFACTOR:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_INVALIDFACTOR);
+    message = ERM_INVALIDFACTOR;
     break;
   case ERR_INVALIDCONSTDECL:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_INVALIDCONSTDECL);
+    message = ERM_INVALIDCONSTDECL;
     break;
   case ERR_INVALIDTYPEDECL:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_INVALIDTYPEDECL);
+    message = ERM_INVALIDTYPEDECL;
     break;
   case ERR_INVALIDVARDECL:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_INVALIDVARDECL);
+    message = ERM_INVALIDVARDECL;
     break;
   case ERR_INVALIDSUBDECL:
-    printf("%d-%d:%s\n", lineNo, colNo, ERM_INVALIDSUBDECL);
+    message = ERM_INVALIDSUBDECL;
     break;
   }
+  snprintf(line, ERROR_LINE_MAX, "%d-%d:%s", lineNo, colNo, message);
+  traceText(line);
   exit(0);
 }
 
 void missingToken(TokenType tokenType, int lineNo, int colNo) {
-  printf("%d-%d:Missing %s\n", lineNo, colNo, tokenToString(tokenType));
+  char line[ERROR_LINE_MAX];
+
+  snprintf(line, ERROR_LINE_MAX, "%d-%d:Missing %s", lineNo, colNo, tokenToString(tokenType));
+  traceText(line);
   exit(0);
 }
 
 void assert(char *msg) {
-  printf("%s\n", msg);
+  traceMessage(msg);
 }
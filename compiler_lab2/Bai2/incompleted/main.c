@@ -6,19 +6,66 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "reader.h"
 #include "parser.h"
+#include "trace.h"
 
 /******************************************************************/
 
+// parser [-b trace] file: parses file, tracing it as text on stdout, or
+// in binary into trace with -b
+// parser -d trace: prints a binary trace as text
 int main(int argc, char *argv[]) {
-  if (argc <= 1) {
+  FILE *binaryTrace = NULL;
+  FILE *f;
+  int decode = 0;
+  int status;
+  int i = 1;
+
+  while ((i < argc) && (argv[i][0] == '-')) {
+    if ((strcmp(argv[i], "-b") == 0) && (i + 1 < argc)) {
+      binaryTrace = fopen(argv[++i], "wb");
+      if (binaryTrace == NULL) {
+        printf("parser: can\'t write %s\n", argv[i]);
+        return -1;
+      }
+    }
+    else if (strcmp(argv[i], "-d") == 0)
+      decode = 1;
+    else {
+      printf("parser: unknown option %s\n", argv[i]);
+      return -1;
+    }
+    i ++;
+  }
+
+  if (i >= argc) {
     printf("parser: no input file.\n");
     return -1;
   }
 
-  if (compile(argv[1]) == IO_ERROR) {
+  if (decode) {
+    f = fopen(argv[i], "rb");
+    if (f == NULL) {
+      printf("Can\'t read input file!\n");
+      return -1;
+    }
+    status = decodeTrace(f);
+    fclose(f);
+    if (status == IO_ERROR) {
+      printf("parser: %s is not a whole trace.\n", argv[i]);
+      return -1;
+    }
+    return 0;
+  }
+
+  if (binaryTrace != NULL)
+    openTrace(binaryTrace, 1);
+  else openTrace(stdout, 0);
+
+  if (compile(argv[i]) == IO_ERROR) {
     printf("Can\'t read input file!\n");
     return -1;
   }
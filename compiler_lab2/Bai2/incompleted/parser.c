@@ -10,6 +10,7 @@
 #include "scanner.h"
 #include "parser.h"
 #include "error.h"
+#include "trace.h"
 
 Token *currentToken;
 Token *lookAhead;
@@ -23,7 +24,7 @@ void scan(void) {
 
 void eat(TokenType tokenType) {
   if (lookAhead->tokenType == tokenType) {
-    printToken(lookAhead);
+    traceToken(lookAhead);
     scan();
   } else missingToken(tokenType, lookAhead->lineNo, lookAhead->colNo);
 }
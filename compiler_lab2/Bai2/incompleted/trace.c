@@ -0,0 +1,391 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reader.h"
+#include "trace.h"
+
+// The trace is built in traceBuffer and written out when it is full: one
+// write for TRACE_BUFFER_SIZE bytes of trace instead of one per line.
+#define TRACE_BUFFER_SIZE (1 << 20)
+
+// Room for a token line or record, its string aside
+#define TOKEN_LINE_MAX 64
+
+#define TOKEN_TYPES_COUNT (SB_RSEL + 1)
+#define MAX_TRACE_MESSAGES 256
+
+// A binary trace is TRACE_MAGIC followed by one record per line of the
+// text trace. The first byte of a record is:
+//  - a TokenType for a token, followed by its line (as the difference
+//    from the previous token's line) and its column, then the length
+//    and bytes of its string for an identifier, a number or a char;
+//  - TR_DEFINE for the first occurrence of a fixed message (assert()):
+//    its number, length and bytes;
+//  - TR_MESSAGE for a later occurrence: its number;
+//  - TR_TEXT for any other line (an error): its length and bytes;
+//  - TR_END, last, when the trace is closed.
+// Numbers are varints, 7 bits a byte from the lowest, the high bit set
+// on all bytes but the last. Line differences are zigzag-encoded.
+#define TRACE_MAGIC "KPLT"
+#define TRACE_MAGIC_LENGTH 4
+
+enum {
+  TR_DEFINE = 0x40,
+  TR_MESSAGE,
+  TR_TEXT,
+  TR_END
+};
+
+// As printToken() prints them
+static char *tokenNames[TOKEN_TYPES_COUNT] = {
+  "TK_NONE", "TK_IDENT", "TK_NUMBER", "TK_CHAR", "TK_EOF",
+
+  "KW_PROGRAM", "KW_CONST", "KW_TYPE", "KW_VAR",
+  "KW_INTEGER", "KW_CHAR", "KW_ARRAY", "KW_OF",
+  "KW_FUNCTION", "KW_PROCEDURE",
+  "KW_BEGIN", "KW_END", "KW_CALL",
+  "KW_IF", "KW_THEN", "KW_ELSE",
+  "KW_WHILE", "KW_DO", "KW_FOR", "KW_TO",
+
+  "SB_SEMICOLON", "SB_COLON", "SB_PERIOD", "SB_COMMA",
+  "SB_ASSIGN", "SB_EQ", "SB_NEQ", "SB_LT", "SB_LE", "SB_GT", "SB_GE",
+  "SB_PLUS", "SB_MINUS", "SB_TIMES", "SB_SLASH",
+  "SB_LPAR", "SB_RPAR", "SB_LSEL", "SB_RSEL"
+};
+
+static char traceBuffer[TRACE_BUFFER_SIZE];
+static size_t traceLength = 0;
+static FILE *traceFile = NULL;
+static int traceBinary = 0;
+static int traceLineNo = 0;
+
+// The fixed messages of a binary trace, by number
+static char *messages[MAX_TRACE_MESSAGES];
+static int messagesCount = 0;
+
+static void flushTrace(void) {
+  fwrite(traceBuffer, 1, traceLength, traceFile);
+  traceLength = 0;
+}
+
+// Makes room for n more bytes, which the emit functions below assume
+static void reserve(size_t n) {
+  if (traceLength + n > TRACE_BUFFER_SIZE)
+    flushTrace();
+}
+
+static void emitChar(int c) {
+  traceBuffer[traceLength ++] = (char) c;
+}
+
+static void emitBytes(const char *bytes, size_t n) {
+  memcpy(traceBuffer + traceLength, bytes, n);
+  traceLength += n;
+}
+
+static void emitString(const char *s) {
+  emitBytes(s, strlen(s));
+}
+
+static void emitNumber(int n) {
+  char digits[12];
+  int count = 0;
+
+  if (n < 0) {
+    emitChar('-');
+    n = -n;
+  }
+  do {
+    digits[count ++] = '0' + n % 10;
+    n /= 10;
+  } while (n > 0);
+  while (count > 0)
+    emitChar(digits[-- count]);
+}
+
+static void emitVarint(unsigned int n) {
+  while (n >= 0x80) {
+    emitChar((n & 0x7F) | 0x80);
+    n >>= 7;
+  }
+  emitChar(n);
+}
+
+// For the lines longer than the buffer, written around it
+static void putBytes(const char *bytes, size_t n) {
+  reserve(n);
+  if (n > TRACE_BUFFER_SIZE)
+    fwrite(bytes, 1, n, traceFile);
+  else emitBytes(bytes, n);
+}
+
+static void putLine(const char *text, size_t length) {
+  putBytes(text, length);
+  reserve(1);
+  emitChar('\n');
+}
+
+static int hasString(TokenType tokenType) {
+  return (tokenType == TK_IDENT) || (tokenType == TK_NUMBER) || (tokenType == TK_CHAR);
+}
+
+static void textToken(TokenType tokenType, int lineNo, int colNo, const char *string, size_t length) {
+  reserve(TOKEN_LINE_MAX + length);
+  emitNumber(lineNo);
+  emitChar('-');
+  emitNumber(colNo);
+  emitChar(':');
+  emitString(tokenNames[tokenType]);
+  switch (tokenType) {
+  case TK_IDENT:
+  case TK_NUMBER:
+    emitChar('(');
+    emitBytes(string, length);
+    emitChar(')');
+    break;
+  case TK_CHAR:
+    emitString("(\'");
+    emitBytes(string, length);
+    emitString("\')");
+    break;
+  default:
+    break;
+  }
+  emitChar('\n');
+}
+
+static void binaryToken(Token *token) {
+  int delta = token->lineNo - traceLineNo;
+  size_t length = hasString(token->tokenType) ? strlen(token->string) : 0;
+
+  reserve(TOKEN_LINE_MAX + length);
+  emitChar(token->tokenType);
+  emitVarint(((unsigned int) delta << 1) ^ (unsigned int) (delta >> 31));
+  emitVarint(token->colNo);
+  if (hasString(token->tokenType)) {
+    emitVarint(length);
+    emitBytes(token->string, length);
+  }
+  traceLineNo = token->lineNo;
+}
+
+static void binaryText(int recordType, int number, const char *text) {
+  size_t length = strlen(text);
+
+  reserve(16);
+  emitChar(recordType);
+  if (number >= 0)
+    emitVarint(number);
+  emitVarint(length);
+  putBytes(text, length);
+}
+
+/******************************************************************/
+
+void openTrace(FILE *file, int binary) {
+  static int registered = 0;
+
+  closeTrace();
+  traceFile = file;
+  traceBinary = binary;
+  traceLineNo = 0;
+  messagesCount = 0;
+  if (binary)
+    putBytes(TRACE_MAGIC, TRACE_MAGIC_LENGTH);
+
+  // The parser stops with exit() at the first error
+  if (!registered) {
+    atexit(closeTrace);
+    registered = 1;
+  }
+}
+
+void closeTrace(void) {
+  if (traceFile == NULL) return;
+  if (traceBinary) {
+    reserve(1);
+    emitChar(TR_END);
+  }
+  flushTrace();
+  fflush(traceFile);
+  traceFile = NULL;
+}
+
+void traceToken(Token *token) {
+  if (traceFile == NULL) openTrace(stdout, 0);
+  if (traceBinary)
+    binaryToken(token);
+  else textToken(token->tokenType, token->lineNo, token->colNo,
+                 token->string, hasString(token->tokenType) ? strlen(token->string) : 0);
+}
+
+// msg is known by its address: a message is defined once, on its first
+// occurrence, and only referred to by number afterwards
+void traceMessage(char *msg) {
+  int i;
+
+  if (traceFile == NULL) openTrace(stdout, 0);
+  if (!traceBinary) {
+    putLine(msg, strlen(msg));
+    return;
+  }
+
+  for (i = messagesCount - 1; i >= 0; i--)
+    if (messages[i] == msg) {
+      reserve(8);
+      emitChar(TR_MESSAGE);
+      emitVarint(i);
+      return;
+    }
+
+  if (messagesCount == MAX_TRACE_MESSAGES) {
+    binaryText(TR_TEXT, -1, msg);
+    return;
+  }
+  messages[messagesCount] = msg;
+  binaryText(TR_DEFINE, messagesCount, msg);
+  messagesCount ++;
+}
+
+// A binary trace is not read as the parser runs, so the line goes to
+// stdout as well
+void traceText(char *text) {
+  if (traceFile == NULL) openTrace(stdout, 0);
+  if (traceBinary) {
+    binaryText(TR_TEXT, -1, text);
+    printf("%s\n", text);
+  } else putLine(text, strlen(text));
+}
+
+/******************************************************************/
+
+static int readVarint(unsigned char **p, unsigned char *end, unsigned int *value) {
+  int shift = 0;
+
+  *value = 0;
+  while (*p < end) {
+    *value |= (unsigned int) (**p & 0x7F) << shift;
+    if ((*(*p) ++ & 0x80) == 0)
+      return 1;
+    shift += 7;
+    if (shift > 28) return 0;
+  }
+  return 0;
+}
+
+static int readBytes(unsigned char **p, unsigned char *end, char **bytes, unsigned int *length) {
+  if (!readVarint(p, end, length) || ((size_t) (end - *p) < *length))
+    return 0;
+  *bytes = (char*) *p;
+  *p += *length;
+  return 1;
+}
+
+// NULL if there is no memory for the whole file
+static unsigned char *readFile(FILE *file, size_t *length) {
+  unsigned char *data = NULL, *grown;
+  size_t capacity = 0, n;
+
+  *length = 0;
+  do {
+    if (*length == capacity) {
+      capacity = (capacity == 0) ? 65536 : capacity * 2;
+      grown = (unsigned char*) realloc(data, capacity);
+      if (grown == NULL) {
+        free(data);
+        return NULL;
+      }
+      data = grown;
+    }
+    n = fread(data + *length, 1, capacity - *length, file);
+    *length += n;
+  } while (n > 0);
+  return data;
+}
+
+// Prints a binary trace as the text trace, on stdout. Returns IO_ERROR
+// if the file is not a whole binary trace; what could be read is printed.
+int decodeTrace(FILE *file) {
+  char *texts[MAX_TRACE_MESSAGES];
+  unsigned int lengths[MAX_TRACE_MESSAGES];
+  int count = 0;
+  unsigned char *data, *p, *end;
+  size_t size;
+  unsigned int delta, colNo, number, length;
+  char *bytes;
+  int recordType;
+  int lineNo = 0;
+  int ended = 0;
+  int status = IO_SUCCESS;
+
+  data = readFile(file, &size);
+  if (data == NULL)
+    return IO_ERROR;
+  p = data;
+  end = data + size;
+  if ((size < TRACE_MAGIC_LENGTH) || (memcmp(data, TRACE_MAGIC, TRACE_MAGIC_LENGTH) != 0)) {
+    free(data);
+    return IO_ERROR;
+  }
+  p += TRACE_MAGIC_LENGTH;
+
+  openTrace(stdout, 0);
+  while ((p < end) && !ended && (status == IO_SUCCESS)) {
+    recordType = *p ++;
+    if (recordType < TOKEN_TYPES_COUNT) {
+      if (!readVarint(&p, end, &delta) || !readVarint(&p, end, &colNo)) {
+        status = IO_ERROR;
+        break;
+      }
+      lineNo += (int) (delta >> 1) ^ -(int) (delta & 1);
+      bytes = "";
+      length = 0;
+      // No token string is longer than MAX_IDENT_LEN, and textToken()
+      // has no room for a longer one
+      if (hasString(recordType) && (!readBytes(&p, end, &bytes, &length) || (length > MAX_IDENT_LEN)))
+        status = IO_ERROR;
+      else textToken(recordType, lineNo, colNo, bytes, length);
+      continue;
+    }
+
+    switch (recordType) {
+    case TR_DEFINE:
+      if (!readVarint(&p, end, &number) || (number != count) || (count == MAX_TRACE_MESSAGES) ||
+          !readBytes(&p, end, &texts[count], &lengths[count]))
+        status = IO_ERROR;
+      else {
+        putLine(texts[count], lengths[count]);
+        count ++;
+      }
+      break;
+    case TR_MESSAGE:
+      if (!readVarint(&p, end, &number) || (number >= count))
+        status = IO_ERROR;
+      else putLine(texts[number], lengths[number]);
+      break;
+    case TR_TEXT:
+      if (!readBytes(&p, end, &bytes, &length))
+        status = IO_ERROR;
+      else putLine(bytes, length);
+      break;
+    case TR_END:
+      ended = 1;
+      break;
+    default:
+      status = IO_ERROR;
+      break;
+    }
+  }
+
+  if (!ended || (p < end))
+    status = IO_ERROR;
+  closeTrace();
+  free(data);
+  return status;
+}
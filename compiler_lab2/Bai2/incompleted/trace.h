@@ -0,0 +1,27 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdio.h>
+#include "token.h"
+
+// The parser's trace: one line per token eaten, per production message
+// and per error. It is written to a file as text (the default, on
+// stdout) or in a compact binary form that decodeTrace() turns back
+// into the same text.
+
+void openTrace(FILE *file, int binary);
+void closeTrace(void);
+
+void traceToken(Token *token);
+void traceMessage(char *msg);
+void traceText(char *text);
+
+int decodeTrace(FILE *file);
+
+#endif
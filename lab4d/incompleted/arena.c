@@ -0,0 +1,73 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_CHUNK_SIZE 65536
+#define ARENA_ALIGN 16
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+
+struct ArenaChunk_ {
+  struct ArenaChunk_ *next;
+  size_t size;
+  size_t used;
+};
+
+typedef struct ArenaChunk_ ArenaChunk;
+
+#define CHUNK_HEADER ARENA_ROUND(sizeof(ArenaChunk))
+
+void* arenaAlloc(Arena *arena, size_t size) {
+  ArenaChunk *chunk = arena->chunks;
+  size_t chunkSize;
+  void *p;
+
+  size = ARENA_ROUND(size);
+  if ((chunk == NULL) || (chunk->used + size > chunk->size)) {
+    chunkSize = (size > ARENA_CHUNK_SIZE) ? size : ARENA_CHUNK_SIZE;
+    chunk = (ArenaChunk*) malloc(CHUNK_HEADER + chunkSize);
+    if (chunk == NULL) return NULL;
+    chunk->size = chunkSize;
+    chunk->used = 0;
+    arena->bytesReserved += CHUNK_HEADER + chunkSize;
+
+    if ((arena->chunks != NULL) && (size > ARENA_CHUNK_SIZE / 4)) {
+      // A large request gets a chunk of its own behind the current one,
+      // which stays open for the small allocations that follow
+      chunk->next = arena->chunks->next;
+      arena->chunks->next = chunk;
+    } else {
+      chunk->next = arena->chunks;
+      arena->chunks = chunk;
+    }
+  }
+
+  p = (char*) chunk + CHUNK_HEADER + chunk->used;
+  chunk->used += size;
+  arena->bytesUsed += size;
+  return p;
+}
+
+void* arenaCalloc(Arena *arena, size_t count, size_t size) {
+  void *p = arenaAlloc(arena, count * size);
+  if (p != NULL)
+    memset(p, 0, count * size);
+  return p;
+}
+
+void freeArena(Arena *arena) {
+  ArenaChunk *chunk;
+
+  while (arena->chunks != NULL) {
+    chunk = arena->chunks;
+    arena->chunks = chunk->next;
+    free(chunk);
+  }
+  arena->bytesUsed = 0;
+  arena->bytesReserved = 0;
+}
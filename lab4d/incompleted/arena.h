@@ -0,0 +1,31 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+// A region allocator: memory is bumped out of large chunks and is only
+// ever released all at once by freeArena().
+
+struct ArenaChunk_;
+
+struct Arena_ {
+  struct ArenaChunk_ *chunks;
+  size_t bytesUsed;
+  size_t bytesReserved;
+};
+
+typedef struct Arena_ Arena;
+
+#define ARENA_INIT {NULL, 0, 0}
+
+void* arenaAlloc(Arena *arena, size_t size);
+void* arenaCalloc(Arena *arena, size_t count, size_t size);
+void freeArena(Arena *arena);
+
+#endif
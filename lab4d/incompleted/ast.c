@@ -0,0 +1,117 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ast.h"
+
+struct AstOpen_ {
+  AstIndex node;
+  AstIndex lastChild;
+  AstIndex beforeLast;
+};
+
+typedef struct AstOpen_ AstOpen;
+
+static AstIndex newNode(Ast *ast, AstKind kind, unsigned int start) {
+  AstIndex index;
+  AstNode *node;
+  int block;
+
+  if (ast->count == 0)
+    ast->count = 1;
+  index = ast->count ++;
+
+  block = index >> AST_BLOCK_BITS;
+  if (block == ast->blocksCount) {
+    if (block == ast->blocksCapacity) {
+      ast->blocksCapacity = (ast->blocksCapacity == 0) ? 16 : ast->blocksCapacity * 2;
+      ast->blocks = (AstNode**) realloc(ast->blocks, ast->blocksCapacity * sizeof(AstNode*));
+    }
+    ast->blocks[block] = (AstNode*) arenaAlloc(&ast->arena, AST_BLOCK_NODES * sizeof(AstNode));
+    ast->blocksCount ++;
+  }
+
+  node = AST_NODE(ast, index);
+  memset(node, 0, sizeof(AstNode));
+  node->kind = kind;
+  node->start = node->end = start;
+  return index;
+}
+
+static void addChild(Ast *ast, AstIndex child) {
+  AstOpen *parent;
+
+  if (ast->depth == 0) return;
+  parent = &ast->open[ast->depth - 1];
+  if (parent->lastChild == AST_NONE)
+    AST_NODE(ast, parent->node)->child = child;
+  else AST_NODE(ast, parent->lastChild)->next = child;
+  parent->beforeLast = parent->lastChild;
+  parent->lastChild = child;
+}
+
+static void push(Ast *ast, AstIndex node, AstIndex lastChild) {
+  AstOpen *open;
+
+  if (ast->depth == ast->openCapacity) {
+    ast->openCapacity = (ast->openCapacity == 0) ? 64 : ast->openCapacity * 2;
+    ast->open = (AstOpen*) realloc(ast->open, ast->openCapacity * sizeof(AstOpen));
+  }
+  open = &ast->open[ast->depth ++];
+  open->node = node;
+  open->lastChild = lastChild;
+  open->beforeLast = AST_NONE;
+}
+
+// Starts a node as the next child of the innermost open one. The nodes
+// started until it is closed become its children.
+AstIndex openAstNode(Ast *ast, AstKind kind, unsigned int start) {
+  AstIndex index = newNode(ast, kind, start);
+  addChild(ast, index);
+  push(ast, index, AST_NONE);
+  return index;
+}
+
+// Starts a node in place of the last child of the innermost open one,
+// which becomes its first child: how a left operand ends up under the
+// operator that follows it
+AstIndex wrapAstNode(Ast *ast, AstKind kind) {
+  AstOpen *parent = &ast->open[ast->depth - 1];
+  AstIndex wrapped = parent->lastChild;
+  AstIndex index = newNode(ast, kind, AST_NODE(ast, wrapped)->start);
+
+  AST_NODE(ast, index)->child = wrapped;
+  if (parent->beforeLast == AST_NONE)
+    AST_NODE(ast, parent->node)->child = index;
+  else AST_NODE(ast, parent->beforeLast)->next = index;
+  parent->lastChild = index;
+
+  push(ast, index, wrapped);
+  return index;
+}
+
+void closeAstNode(Ast *ast, unsigned int end) {
+  ast->depth --;
+  AST_NODE(ast, ast->open[ast->depth].node)->end = end;
+}
+
+// Leaves the nodes an error left open as they are, partly built
+void unwindAst(Ast *ast, int depth) {
+  if (depth < ast->depth)
+    ast->depth = depth;
+}
+
+void freeAst(Ast *ast) {
+  freeArena(&ast->arena);
+  free(ast->blocks);
+  free(ast->open);
+  ast->blocks = NULL;
+  ast->open = NULL;
+  ast->blocksCount = ast->blocksCapacity = ast->openCapacity = 0;
+  ast->count = 0;
+  ast->depth = 0;
+}
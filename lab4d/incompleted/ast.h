@@ -0,0 +1,92 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __AST_H__
+#define __AST_H__
+
+#include "token.h"
+#include "symtab.h"
+#include "arena.h"
+
+// The syntax tree the parser builds with kplc -a. Nodes are fixed-size
+// and live in blocks bumped out of an arena; they refer to each other
+// by 32-bit index, and the whole tree is released at once by freeAst().
+
+typedef unsigned int AstIndex;
+
+// Index 0 is never a node; the first node opened is the root
+#define AST_NONE 0
+#define AST_ROOT 1
+
+typedef enum {
+  AST_PROGRAM,     // object; the declarations, then the body
+  AST_CONST_DECL,  // object
+  AST_TYPE_DECL,   // object, type
+  AST_VAR_DECL,    // object, type
+  AST_FUNCTION,    // object, type (the return type); params, declarations, body
+  AST_PROCEDURE,   // object; params, declarations, body
+  AST_PARAM,       // object, type
+
+  AST_COMPOUND,    // the statements
+  AST_EMPTY,
+  AST_ASSIGN,      // lvalue, expression
+  AST_CALL,        // object, type for a function; the arguments
+  AST_IF,          // condition, statement, else statement if any
+  AST_WHILE,       // condition, statement
+  AST_FOR,         // object; from, to, statement
+
+  AST_CONDITION,   // op; left, right
+  AST_UNARY,       // op, type; operand
+  AST_BINARY,      // op, type; left, right
+  AST_NUMBER,      // value, type
+  AST_CHAR,        // value, type
+  AST_CONSTANT,    // object, type
+  AST_VARIABLE     // object, type after indexing; the indexes
+} AstKind;
+
+// start and end are the offsets of the first and the last token of the
+// node in the source. Children are linked through next.
+typedef struct {
+  unsigned char kind;
+  unsigned char op;
+  AstIndex child;
+  AstIndex next;
+  unsigned int start;
+  unsigned int end;
+  KplInt value;
+  Object *object;
+  Type *type;
+} AstNode;
+
+struct AstOpen_;
+
+typedef struct {
+  Arena arena;
+  AstNode **blocks;
+  int blocksCount;
+  int blocksCapacity;
+  AstIndex count;
+  // The nodes being built, innermost last, each with its last child
+  struct AstOpen_ *open;
+  int depth;
+  int openCapacity;
+} Ast;
+
+#define AST_INIT {ARENA_INIT, NULL, 0, 0, 0, NULL, 0, 0}
+
+#define AST_BLOCK_BITS 12
+#define AST_BLOCK_NODES (1 << AST_BLOCK_BITS)
+
+#define AST_NODE(ast, index) \
+  (&(ast)->blocks[(index) >> AST_BLOCK_BITS][(index) & (AST_BLOCK_NODES - 1)])
+
+AstIndex openAstNode(Ast *ast, AstKind kind, unsigned int start);
+AstIndex wrapAstNode(Ast *ast, AstKind kind);
+void closeAstNode(Ast *ast, unsigned int end);
+void unwindAst(Ast *ast, int depth);
+void freeAst(Ast *ast);
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "atom.h"
+
+#define ATOM_POOL_CHUNK 65536
+#define ATOM_MIN_SLOTS 1024
+
+struct AtomPool_ {
+  struct AtomPool_ *next;
+  size_t used;
+  char text[ATOM_POOL_CHUNK];
+};
+
+typedef struct AtomPool_ AtomPool;
+
+// Names are copied into pool chunks that are never moved, which keeps
+// the pointers returned by atomName() valid until freeAtoms(). The
+// slots are an open-addressing index from name hash to atom id + 1
+// (0 is empty).
+static AtomTable atoms = ATOM_TABLE_INIT;
+
+static unsigned int hashName(const char *name, int length) {
+  unsigned int h = 2166136261u;
+  int i;
+  for (i = 0; i < length; i++) {
+    h ^= (unsigned char) name[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static char *storeName(AtomTable *table, const char *name, int length) {
+  AtomPool *chunk;
+  char *s;
+
+  if ((table->pool == NULL) || (table->pool->used + length + 1 > ATOM_POOL_CHUNK)) {
+    chunk = (AtomPool*) malloc(sizeof(AtomPool));
+    chunk->next = table->pool;
+    chunk->used = 0;
+    table->pool = chunk;
+  }
+  s = table->pool->text + table->pool->used;
+  memcpy(s, name, length);
+  s[length] = '\0';
+  table->pool->used += length + 1;
+  return s;
+}
+
+static void growSlots(AtomTable *table) {
+  unsigned int newSize = (table->slotsSize == 0) ? ATOM_MIN_SLOTS : table->slotsSize * 2;
+  unsigned int h;
+  int i;
+
+  free(table->slots);
+  table->slots = (int*) calloc(newSize, sizeof(int));
+  table->slotsSize = newSize;
+  for (i = 0; i < table->count; i++) {
+    h = hashName(table->names[i], strlen(table->names[i])) & (newSize - 1);
+    while (table->slots[h] != 0)
+      h = (h + 1) & (newSize - 1);
+    table->slots[h] = i + 1;
+  }
+}
+
+int internAtomIn(AtomTable *table, const char *name, int length) {
+  unsigned int h;
+  char *s;
+  int atom;
+
+  // Keep the index at most half full
+  if (2 * (unsigned int) (table->count + 1) > table->slotsSize)
+    growSlots(table);
+
+  h = hashName(name, length) & (table->slotsSize - 1);
+  while (table->slots[h] != 0) {
+    s = table->names[table->slots[h] - 1];
+    if ((strncmp(s, name, length) == 0) && (s[length] == '\0'))
+      return table->slots[h] - 1;
+    h = (h + 1) & (table->slotsSize - 1);
+  }
+
+  if (table->count == table->capacity) {
+    table->capacity = (table->capacity == 0) ? ATOM_MIN_SLOTS : table->capacity * 2;
+    table->names = (char**) realloc(table->names, table->capacity * sizeof(char*));
+  }
+  atom = table->count ++;
+  table->names[atom] = storeName(table, name, length);
+  table->slots[h] = atom + 1;
+  return atom;
+}
+
+void freeAtomTable(AtomTable *table) {
+  AtomPool *chunk;
+
+  while (table->pool != NULL) {
+    chunk = table->pool;
+    table->pool = chunk->next;
+    free(chunk);
+  }
+  free(table->names);
+  free(table->slots);
+  table->names = NULL;
+  table->slots = NULL;
+  table->count = table->capacity = 0;
+  table->slotsSize = 0;
+}
+
+int internAtom(const char *name, int length) {
+  return internAtomIn(&atoms, name, length);
+}
+
+char *atomName(int atom) {
+  return atoms.names[atom];
+}
+
+int atomCount(void) {
+  return atoms.count;
+}
+
+void freeAtoms(void) {
+  freeAtomTable(&atoms);
+}
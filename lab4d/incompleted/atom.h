@@ -0,0 +1,39 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __ATOM_H__
+#define __ATOM_H__
+
+#include <stddef.h>
+
+// Interned identifier names. Each distinct name is stored once and is
+// known by a small integer id and a stable pointer, so two names are
+// equal exactly when their ids (or pointers) are.
+
+struct AtomPool_;
+
+// The compiler interns into one global table (internAtom() and friends);
+// an AtomTable of its own lets a scanning thread intern without locking.
+typedef struct {
+  struct AtomPool_ *pool;
+  char **names;
+  int count;
+  int capacity;
+  int *slots;
+  unsigned int slotsSize;
+} AtomTable;
+
+#define ATOM_TABLE_INIT {NULL, NULL, 0, 0, NULL, 0}
+
+int internAtomIn(AtomTable *table, const char *name, int length);
+void freeAtomTable(AtomTable *table);
+
+int internAtom(const char *name, int length);
+char *atomName(int atom);
+int atomCount(void);
+void freeAtoms(void);
+
+#endif
@@ -0,0 +1,99 @@
+/* Keyword lookup microbenchmark
+ * Times checkKeyword() against the former linear scan of the keyword
+ * list over an identifier-heavy stream of upper-cased words.
+ *
+ * usage: bench_keyword [rounds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "token.h"
+
+#define WORD_COUNT 8192
+
+struct {
+  char *string;
+  TokenType tokenType;
+} linearKeywords[KEYWORDS_COUNT] = {
+  {"PROGRAM", KW_PROGRAM}, {"CONST", KW_CONST}, {"TYPE", KW_TYPE},
+  {"VAR", KW_VAR}, {"INTEGER", KW_INTEGER}, {"CHAR", KW_CHAR},
+  {"ARRAY", KW_ARRAY}, {"OF", KW_OF}, {"FUNCTION", KW_FUNCTION},
+  {"PROCEDURE", KW_PROCEDURE}, {"BEGIN", KW_BEGIN}, {"END", KW_END},
+  {"CALL", KW_CALL}, {"IF", KW_IF}, {"THEN", KW_THEN},
+  {"ELSE", KW_ELSE}, {"WHILE", KW_WHILE}, {"DO", KW_DO},
+  {"FOR", KW_FOR}, {"TO", KW_TO}
+};
+
+char words[WORD_COUNT][MAX_IDENT_LEN + 1];
+
+// The lookup checkKeyword() used to do: compare with every keyword in turn
+TokenType linearCheckKeyword(char *string) {
+  int i;
+  for (i = 0; i < KEYWORDS_COUNT; i++)
+    if (strcmp(linearKeywords[i].string, string) == 0)
+      return linearKeywords[i].tokenType;
+  return TK_NONE;
+}
+
+// Three identifiers for every keyword, with identifier lengths spread
+// over 1..MAX_IDENT_LEN like generated code
+void makeWords(void) {
+  static const char alnum[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  int i, j, len;
+
+  srand(12345);
+  for (i = 0; i < WORD_COUNT; i++) {
+    if (i % 4 == 0) {
+      strcpy(words[i], linearKeywords[rand() % KEYWORDS_COUNT].string);
+      continue;
+    }
+    len = 1 + rand() % MAX_IDENT_LEN;
+    words[i][0] = alnum[rand() % 26];
+    for (j = 1; j < len; j++)
+      words[i][j] = alnum[rand() % 36];
+    words[i][len] = '\0';
+  }
+}
+
+double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double timeLookups(TokenType (*lookup)(char *), int rounds, long *checksum) {
+  double start = now();
+  int r, i;
+
+  *checksum = 0;
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < WORD_COUNT; i++)
+      *checksum += lookup(words[i]);
+  return now() - start;
+}
+
+int main(int argc, char *argv[]) {
+  int rounds = (argc > 1) ? atoi(argv[1]) : 2000;
+  long linearSum, hashSum;
+  double linearTime, hashTime, lookups;
+  int i;
+
+  makeWords();
+  for (i = 0; i < WORD_COUNT; i++)
+    if (checkKeyword(words[i]) != linearCheckKeyword(words[i])) {
+      printf("mismatch on %s\n", words[i]);
+      return 1;
+    }
+
+  linearTime = timeLookups(linearCheckKeyword, rounds, &linearSum);
+  hashTime = timeLookups(checkKeyword, rounds, &hashSum);
+  lookups = (double) rounds * WORD_COUNT;
+
+  printf("lookups: %.0f (checksums %ld/%ld)\n", lookups, linearSum, hashSum);
+  printf("linear scan:  %.2f ns/lookup\n", linearTime * 1e9 / lookups);
+  printf("perfect hash: %.2f ns/lookup\n", hashTime * 1e9 / lookups);
+  printf("speedup:      %.1fx\n", linearTime / hashTime);
+  return 0;
+}
@@ -0,0 +1,305 @@
+/* Scanner throughput benchmark
+ * Generates KPL sources of a given size and shape, then times the
+ * scanner over them: getToken() one token at a time, and tokenizeText()
+ * into a token stream. Reports tokens/s, MB/s and the heap allocations
+ * made while scanning (counted by wrapping malloc, see the Makefile).
+ *
+ * usage: bench_scanner [-s megabytes] [-r rounds] [-seed n] [-json] [shape...]
+ * shapes: ident comment number nesting mixed (default: all of them)
+ *
+ * With -json each result is printed as one JSON object per line.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "reader.h"
+#include "scanner.h"
+#include "tokenstream.h"
+#include "atom.h"
+
+/******************************************************************/
+/* Allocation counting                                            */
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+long allocCount = 0;
+long allocBytes = 0;
+
+void *__wrap_malloc(size_t size) {
+  allocCount ++;
+  allocBytes += size;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  allocCount ++;
+  allocBytes += count * size;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  allocCount ++;
+  allocBytes += size;
+  return __real_realloc(ptr, size);
+}
+
+/******************************************************************/
+/* Corpus generator                                               */
+
+typedef struct {
+  char *text;
+  size_t length;
+  size_t capacity;
+} Source;
+
+void emit(Source *src, const char *s) {
+  size_t len = strlen(s);
+
+  if (src->length + len + 1 > src->capacity) {
+    src->capacity = 2 * (src->length + len + 1);
+    src->text = (char*) __real_realloc(src->text, src->capacity);
+  }
+  memcpy(src->text + src->length, s, len + 1);
+  src->length += len;
+}
+
+void emitIndent(Source *src, int depth) {
+  int i;
+  for (i = 0; i < depth; i++)
+    emit(src, "  ");
+}
+
+void emitIdent(Source *src) {
+  static const char alnum[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  char name[16];
+  int len = 1 + rand() % 15;
+  int i;
+
+  name[0] = alnum[rand() % 52];
+  for (i = 1; i < len; i++)
+    name[i] = alnum[rand() % 62];
+  name[len] = '\0';
+  emit(src, name);
+}
+
+void emitNumber(Source *src) {
+  char number[16];
+  snprintf(number, sizeof(number), "%d", rand() % 1000000);
+  emit(src, number);
+}
+
+// Assignments between long random identifiers, a few keywords between
+void genIdent(Source *src) {
+  static const char *ops[] = {" + ", " - ", " * ", " / "};
+  int i, n = 2 + rand() % 6;
+
+  emit(src, "  ");
+  emitIdent(src);
+  emit(src, " := ");
+  for (i = 0; i < n; i++) {
+    if (i > 0) emit(src, ops[rand() % 4]);
+    emitIdent(src);
+  }
+  emit(src, (rand() % 8 == 0) ? ";\n  Call proc(x, y);\n" : ";\n");
+}
+
+// Generated-file headers: long comment blocks around a little code
+void genComment(Source *src) {
+  int i, n = 5 + rand() % 30;
+
+  emit(src, "(*");
+  for (i = 0; i < n; i++)
+    emit(src, " * Generated by the build; do not edit. See the template for details.\n");
+  emit(src, " *)\n  x := x + 1; (* step *)\n");
+}
+
+// Arithmetic on constants and array indexes
+void genNumber(Source *src) {
+  int i, n = 3 + rand() % 8;
+
+  emit(src, "  a(.");
+  emitNumber(src);
+  emit(src, ".) := ");
+  for (i = 0; i < n; i++) {
+    if (i > 0) emit(src, (rand() % 2) ? " + " : " * ");
+    emitNumber(src);
+  }
+  emit(src, ";\n");
+}
+
+// Deeply nested statements with the indentation that comes with them
+void genNesting(Source *src) {
+  int depth = 4 + rand() % 20;
+  int i;
+
+  for (i = 0; i < depth; i++) {
+    emitIndent(src, i + 1);
+    emit(src, (i % 2) ? "While i < 10 Do Begin\n" : "If a(.i.) <= 'z' Then Begin\n");
+  }
+  emitIndent(src, depth + 1);
+  emit(src, "i := i + 1\n");
+  for (i = depth - 1; i >= 0; i--) {
+    emitIndent(src, i + 1);
+    emit(src, "End;\n");
+  }
+}
+
+typedef struct {
+  const char *name;
+  void (*generate)(Source *src);
+} Shape;
+
+void genMixed(Source *src);
+
+Shape shapes[] = {
+  {"ident", genIdent},
+  {"comment", genComment},
+  {"number", genNumber},
+  {"nesting", genNesting},
+  {"mixed", genMixed}
+};
+
+#define SHAPES_COUNT 5
+
+void genMixed(Source *src) {
+  shapes[rand() % (SHAPES_COUNT - 1)].generate(src);
+}
+
+void generate(Source *src, Shape *shape, size_t size) {
+  src->text = NULL;
+  src->length = src->capacity = 0;
+  emit(src, "Program bench;\nBegin\n");
+  while (src->length < size)
+    shape->generate(src);
+  emit(src, "End.\n");
+}
+
+/******************************************************************/
+/* Timing                                                         */
+
+typedef struct {
+  double seconds;
+  long tokens;
+  long allocations;
+  long allocatedBytes;
+} Result;
+
+double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void scanTokens(Source *src, Result *result) {
+  double start;
+  long tokens = 0;
+
+  openInputBuffer(src->text, src->length);
+  allocCount = allocBytes = 0;
+  start = now();
+  while (getToken()->tokenType != TK_EOF)
+    tokens ++;
+  result->seconds = now() - start;
+  result->tokens = tokens + 1;
+  result->allocations = allocCount;
+  result->allocatedBytes = allocBytes;
+  closeInputStream();
+  freeAtoms();
+}
+
+void scanStream(Source *src, Result *result) {
+  TokenStream stream;
+  double start;
+
+  initTokenStream(&stream);
+  allocCount = allocBytes = 0;
+  start = now();
+  tokenizeText(&stream, src->text, src->length);
+  result->seconds = now() - start;
+  result->tokens = stream.count;
+  result->allocations = allocCount;
+  result->allocatedBytes = allocBytes;
+  freeTokenStream(&stream);
+  freeAtoms();
+}
+
+// Best of rounds, so that a stray context switch does not count
+void bench(Source *src, void (*scan)(Source*, Result*), int rounds, Result *best) {
+  Result result;
+  int r;
+
+  for (r = 0; r < rounds; r++) {
+    scan(src, &result);
+    if ((r == 0) || (result.seconds < best->seconds))
+      *best = result;
+  }
+}
+
+void report(const char *shape, const char *mode, size_t bytes, Result *result, int json) {
+  double mb = bytes / (1024.0 * 1024.0);
+
+  if (json)
+    printf("{\"shape\":\"%s\",\"mode\":\"%s\",\"bytes\":%lu,\"tokens\":%ld,"
+           "\"seconds\":%.6f,\"tokens_per_sec\":%.0f,\"mb_per_sec\":%.2f,"
+           "\"allocations\":%ld,\"allocated_bytes\":%ld}\n",
+           shape, mode, (unsigned long) bytes, result->tokens, result->seconds,
+           result->tokens / result->seconds, mb / result->seconds,
+           result->allocations, result->allocatedBytes);
+  else
+    printf("%-8s %-13s %8.2f MB %10ld tokens %8.3f s %12.0f tok/s %8.1f MB/s %8ld allocs %10ld bytes\n",
+           shape, mode, mb, result->tokens, result->seconds,
+           result->tokens / result->seconds, mb / result->seconds,
+           result->allocations, result->allocatedBytes);
+}
+
+int main(int argc, char *argv[]) {
+  size_t size = 8 << 20;
+  int rounds = 3;
+  int seed = 12345;
+  int json = 0;
+  int selected[SHAPES_COUNT];
+  int anySelected = 0;
+  Source src;
+  Result result;
+  int i, k;
+
+  memset(selected, 0, sizeof(selected));
+  for (i = 1; i < argc; i++) {
+    if ((strcmp(argv[i], "-s") == 0) && (i + 1 < argc))
+      size = (size_t) (atof(argv[++i]) * (1 << 20));
+    else if ((strcmp(argv[i], "-r") == 0) && (i + 1 < argc))
+      rounds = atoi(argv[++i]);
+    else if ((strcmp(argv[i], "-seed") == 0) && (i + 1 < argc))
+      seed = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-json") == 0)
+      json = 1;
+    else {
+      for (k = 0; k < SHAPES_COUNT; k++)
+        if (strcmp(argv[i], shapes[k].name) == 0) break;
+      if (k == SHAPES_COUNT) {
+        printf("bench_scanner: unknown shape or option %s\n", argv[i]);
+        return 1;
+      }
+      selected[k] = anySelected = 1;
+    }
+  }
+  if (rounds < 1) rounds = 1;
+
+  for (k = 0; k < SHAPES_COUNT; k++) {
+    if (anySelected && !selected[k]) continue;
+    srand(seed);
+    generate(&src, &shapes[k], size);
+
+    bench(&src, scanTokens, rounds, &result);
+    report(shapes[k].name, "getToken", src.length, &result, json);
+    bench(&src, scanStream, rounds, &result);
+    report(shapes[k].name, "tokenizeText", src.length, &result, json);
+
+    free(src.text);
+  }
+  return 0;
+}
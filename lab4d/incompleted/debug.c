@@ -5,6 +5,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include "debug.h"
 
 void pad(int n) {
@@ -31,7 +32,7 @@ void printType(Type* type) {
 void printConstantValue(ConstantValue* value) {
   switch (value->type) {
   case TP_INT:
-    printf("%d",value->intValue);
+    printf(KPL_INT_FORMAT,value->intValue);
     break;
   case TP_CHAR:
     printf("\'%c\'",value->charValue);
@@ -99,3 +100,97 @@ void printScope(Scope* scope, int indent) {
   printObjectList(scope->objList, indent);
 }
 
+
+static char *astKindNames[] = {
+  "Program", "ConstDecl", "TypeDecl", "VarDecl", "Function", "Procedure", "Param",
+  "Compound", "Empty", "Assign", "Call", "If", "While", "For",
+  "Condition", "Unary", "Binary", "Number", "Char", "Constant", "Variable"
+};
+
+// Nodes deeper than this are printed at this indent, after their depth
+#define AST_MAX_INDENT 64
+
+typedef struct {
+  AstIndex index;
+  int indent;
+} AstVisit;
+
+static AstVisit *astVisits = NULL;
+static int astVisitsCount = 0;
+static int astVisitsCapacity = 0;
+
+static void visitAstNode(AstIndex index, int indent) {
+  if (astVisitsCount == astVisitsCapacity) {
+    astVisitsCapacity = (astVisitsCapacity == 0) ? 256 : astVisitsCapacity * 2;
+    astVisits = (AstVisit*) realloc(astVisits, astVisitsCapacity * sizeof(AstVisit));
+  }
+  astVisits[astVisitsCount].index = index;
+  astVisits[astVisitsCount].indent = indent;
+  astVisitsCount ++;
+}
+
+static void printAstNode(AstNode *node, int indent) {
+  if (indent > AST_MAX_INDENT) {
+    pad(AST_MAX_INDENT);
+    printf("%d: ", indent);
+  } else pad(indent);
+  printf("%s", astKindNames[node->kind]);
+  if (node->object != NULL)
+    printf(" %s", node->object->name);
+  if ((node->kind == AST_CONDITION) || (node->kind == AST_UNARY) || (node->kind == AST_BINARY))
+    printf(" %s", tokenToString(node->op));
+  if (node->kind == AST_NUMBER)
+    printf(" " KPL_INT_FORMAT, node->value);
+  if (node->kind == AST_CHAR)
+    printf(" \'%c\'", (char) node->value);
+  if (node->type != NULL) {
+    printf(" : ");
+    printType(node->type);
+  }
+  printf(" [%u-%u]\n", node->start, node->end);
+}
+
+// One node a line, its children indented under it: the kind, then the
+// name of its object, its operator or value and its type, then the
+// offsets of its first and last tokens. A chain of one binary operator,
+// such as a + b + c, is printed as one node with all the operands under
+// it, from the left. The tree is walked with a stack of its own, for
+// chains of operators make it as deep as they are long.
+void printAst(Ast* ast, AstIndex index, int indent) {
+  AstNode *node;
+  AstNode *left;
+  AstIndex child;
+  AstVisit visit;
+  int first, i, j;
+
+  astVisitsCount = 0;
+  visitAstNode(index, indent);
+  while (astVisitsCount > 0) {
+    visit = astVisits[-- astVisitsCount];
+    node = AST_NODE(ast, visit.index);
+    printAstNode(node, visit.indent);
+
+    if (node->kind == AST_BINARY) {
+      // The right operands down the chain come last to first; the
+      // leftmost operand, pushed last, is printed first
+      while (1) {
+        left = AST_NODE(ast, node->child);
+        visitAstNode(left->next, visit.indent + 2);
+        if ((left->kind != AST_BINARY) || (left->op != node->op)) break;
+        node = left;
+      }
+      visitAstNode(node->child, visit.indent + 2);
+      continue;
+    }
+
+    // The children are pushed in order, then turned round
+    first = astVisitsCount;
+    for (child = node->child; child != AST_NONE; child = AST_NODE(ast, child)->next)
+      visitAstNode(child, visit.indent + 2);
+    for (i = first, j = astVisitsCount - 1; i < j; i++, j--) {
+      visit = astVisits[i];
+      astVisits[i] = astVisits[j];
+      astVisits[j] = visit;
+    }
+  }
+}
@@ -8,11 +8,13 @@
 #define __DEBUG_H_
 
 #include "symtab.h"
+#include "ast.h"
 
 void printType(Type* type);
 void printConstantValue(ConstantValue* value);
 void printObject(Object* obj, int indent);
 void printObjectList(ObjectNode* objList, int indent);
 void printScope(Scope* scope, int indent);
+void printAst(Ast* ast, AstIndex index, int indent);
 
 #endif
@@ -6,20 +6,22 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <setjmp.h>
 #include "error.h"
 
-#define NUM_OF_ERRORS 29
+#define NUM_OF_ERRORS 30
 
 struct ErrorMessage {
   ErrorCode errorCode;
   char *message;
 };
 
-struct ErrorMessage errors[29] = {
+struct ErrorMessage errors[30] = {
   {ERR_END_OF_COMMENT, "End of comment expected."},
   {ERR_IDENT_TOO_LONG, "Identifier too long."},
   {ERR_INVALID_CONSTANT_CHAR, "Invalid char constant."},
   {ERR_INVALID_SYMBOL, "Invalid symbol."},
+  {ERR_NUMBER_TOO_LARGE, "Number too large."},
   {ERR_INVALID_IDENT, "An identifier expected."},
   {ERR_INVALID_CONSTANT, "A constant expected."},
   {ERR_INVALID_TYPE, "A type expected."},
@@ -47,20 +49,126 @@ struct ErrorMessage errors[29] = {
   {ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, "The number of arguments and the number of parameters are inconsistent."}
 };
 
-void error(ErrorCode err, int lineNo, int colNo) {
+// At most maxErrors errors are reported (0: no limit); the compiler
+// stops at the last one. With the default of 1 it stops at the first
+// error, as it always has.
+int maxErrors = 1;
+
+// Set by the parser while it can resume after an error: error() and
+// missingToken() jump back there instead of stopping the compiler
+_Thread_local sigjmp_buf *errorRecovery = NULL;
+
+// Set by deferErrors() while a thread parses part of the input in
+// parallel: its errors are only recorded, and where the compiler would
+// stop the thread jumps there instead. The recorded errors are printed
+// later, in source order, through replayError().
+static _Thread_local sigjmp_buf *errorStop = NULL;
+
+static _Thread_local ErrorReport *reports = NULL;
+static _Thread_local int reportsCount = 0;
+static _Thread_local int reportsCapacity = 0;
+
+static char *errorMessage(ErrorCode err) {
   int i;
   for (i = 0 ; i < NUM_OF_ERRORS; i ++) 
-    if (errors[i].errorCode == err) {
-      printf("%d-%d:%s\n", lineNo, colNo, errors[i].message);
-      exit(0);
-    }
+    if (errors[i].errorCode == err)
+      return errors[i].message;
+  return "";
 }
 
-void missingToken(TokenType tokenType, int lineNo, int colNo) {
-  printf("%d-%d:Missing %s\n", lineNo, colNo, tokenToString(tokenType));
+// Records and prints an error. An error at the very place of the
+// previous one is a consequence of it and is left out.
+static void addReport(ErrorCode err, TokenType missing, int lineNo, int colNo) {
+  ErrorReport *last = (reportsCount > 0) ? &reports[reportsCount - 1] : NULL;
+
+  if ((last != NULL) && (last->lineNo == lineNo) && (last->colNo == colNo))
+    return;
+
+  if (reportsCount == reportsCapacity) {
+    reportsCapacity = (reportsCapacity == 0) ? 16 : reportsCapacity * 2;
+    reports = (ErrorReport*) realloc(reports, reportsCapacity * sizeof(ErrorReport));
+  }
+  reports[reportsCount].errorCode = err;
+  reports[reportsCount].missingToken = missing;
+  reports[reportsCount].lineNo = lineNo;
+  reports[reportsCount].colNo = colNo;
+  reportsCount ++;
+
+  if (errorStop != NULL) {
+    if (reportsCount == maxErrors)
+      siglongjmp(*errorStop, 1);
+    return;
+  }
+
+  if (missing == TK_NONE)
+    printf("%d-%d:%s\n", lineNo, colNo, errorMessage(err));
+  else printf("%d-%d:Missing %s\n", lineNo, colNo, tokenToString(missing));
+
+  if (reportsCount == maxErrors)
+    exit(0);
+}
+
+static void recover(void) {
+  if (errorRecovery != NULL)
+    siglongjmp(*errorRecovery, 1);
+  if (errorStop != NULL)
+    siglongjmp(*errorStop, 1);
   exit(0);
 }
 
+void error(ErrorCode err, int lineNo, int colNo) {
+  addReport(err, TK_NONE, lineNo, colNo);
+  recover();
+}
+
+void missingToken(TokenType tokenType, int lineNo, int colNo) {
+  addReport(0, tokenType, lineNo, colNo);
+  recover();
+}
+
+// For the errors the caller gets over by itself, like the scanner
+// skipping an invalid token: reports and returns
+void reportError(ErrorCode err, int lineNo, int colNo) {
+  addReport(err, TK_NONE, lineNo, colNo);
+}
+
+int errorCount(void) {
+  return reportsCount;
+}
+
+ErrorReport *errorList(void) {
+  return reports;
+}
+
+// stop == NULL prints the errors again as they come. Either way the
+// thread is left without a recovery point.
+void deferErrors(sigjmp_buf *stop) {
+  errorStop = stop;
+  errorRecovery = NULL;
+}
+
+// Hands the calling thread's errors over to the caller, who frees them
+ErrorReport *takeErrors(int *count) {
+  ErrorReport *list = reports;
+
+  *count = reportsCount;
+  reports = NULL;
+  reportsCount = reportsCapacity = 0;
+  return list;
+}
+
+// Reports a deferred error as if it had just been raised, but returns
+// (unless it is the last one allowed)
+void replayError(ErrorReport *report) {
+  addReport(report->errorCode, report->missingToken, report->lineNo, report->colNo);
+}
+
+void clearErrors(void) {
+  free(reports);
+  reports = NULL;
+  reportsCount = reportsCapacity = 0;
+}
+
 void assert(char *msg) {
   printf("%s\n", msg);
 }
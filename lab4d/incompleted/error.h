@@ -6,6 +6,7 @@
 
 #ifndef __ERROR_H__
 #define __ERROR_H__
+#include <setjmp.h>
 #include "token.h"
 
 typedef enum {
@@ -13,6 +14,7 @@ typedef enum {
   ERR_IDENT_TOO_LONG,
   ERR_INVALID_CONSTANT_CHAR,
   ERR_INVALID_SYMBOL,
+  ERR_NUMBER_TOO_LARGE,
   ERR_INVALID_IDENT,
   ERR_INVALID_CONSTANT,
   ERR_INVALID_TYPE,
@@ -40,8 +42,27 @@ typedef enum {
   ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY
 } ErrorCode;
 
+// An entry of the error list. missingToken is TK_NONE for the errors
+// raised by error(), and the expected token (errorCode unused) for the
+// ones raised by missingToken().
+typedef struct {
+  ErrorCode errorCode;
+  TokenType missingToken;
+  int lineNo;
+  int colNo;
+} ErrorReport;
+
 void error(ErrorCode err, int lineNo, int colNo);
 void missingToken(TokenType tokenType, int lineNo, int colNo);
+void reportError(ErrorCode err, int lineNo, int colNo);
+
+void deferErrors(sigjmp_buf *stop);
+ErrorReport *takeErrors(int *count);
+void replayError(ErrorReport *report);
+
+int errorCount(void);
+ErrorReport *errorList(void);
+void clearErrors(void);
 void assert(char *msg);
 
 #endif
@@ -0,0 +1,209 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include "grammar.h"
+
+// Grammar symbols: a TokenType for a terminal, NT(x) for nonterminal x
+#define NT_BASE 64
+#define NT(x) (NT_BASE + (x))
+#define IS_NT(symbol) ((symbol) >= NT_BASE)
+#define END_OF_RULE (-1)
+
+#define GRAMMAR_MAX_RHS 10
+
+typedef struct {
+  Nonterminal lhs;
+  int rhs[GRAMMAR_MAX_RHS];
+} GrammarRule;
+
+// KPL in the LL(1) form the parser follows. A rule with an empty right
+// hand side derives the empty string. Factor and LValue list both
+// readings of an identifier; which one applies is a semantic matter.
+static const GrammarRule rules[] = {
+  {NT_PROGRAM, {KW_PROGRAM, TK_IDENT, SB_SEMICOLON, NT(NT_BLOCK), SB_PERIOD, END_OF_RULE}},
+
+  {NT_BLOCK, {KW_CONST, NT(NT_CONST_DECL), NT(NT_CONST_DECLS), NT(NT_BLOCK2), END_OF_RULE}},
+  {NT_BLOCK, {NT(NT_BLOCK2), END_OF_RULE}},
+  {NT_CONST_DECLS, {NT(NT_CONST_DECL), NT(NT_CONST_DECLS), END_OF_RULE}},
+  {NT_CONST_DECLS, {END_OF_RULE}},
+  {NT_CONST_DECL, {TK_IDENT, SB_EQ, NT(NT_CONSTANT), SB_SEMICOLON, END_OF_RULE}},
+
+  {NT_BLOCK2, {KW_TYPE, NT(NT_TYPE_DECL), NT(NT_TYPE_DECLS), NT(NT_BLOCK3), END_OF_RULE}},
+  {NT_BLOCK2, {NT(NT_BLOCK3), END_OF_RULE}},
+  {NT_TYPE_DECLS, {NT(NT_TYPE_DECL), NT(NT_TYPE_DECLS), END_OF_RULE}},
+  {NT_TYPE_DECLS, {END_OF_RULE}},
+  {NT_TYPE_DECL, {TK_IDENT, SB_EQ, NT(NT_TYPE), SB_SEMICOLON, END_OF_RULE}},
+
+  {NT_BLOCK3, {KW_VAR, NT(NT_VAR_DECL), NT(NT_VAR_DECLS), NT(NT_BLOCK4), END_OF_RULE}},
+  {NT_BLOCK3, {NT(NT_BLOCK4), END_OF_RULE}},
+  {NT_VAR_DECLS, {NT(NT_VAR_DECL), NT(NT_VAR_DECLS), END_OF_RULE}},
+  {NT_VAR_DECLS, {END_OF_RULE}},
+  {NT_VAR_DECL, {TK_IDENT, SB_COLON, NT(NT_TYPE), SB_SEMICOLON, END_OF_RULE}},
+
+  {NT_BLOCK4, {NT(NT_SUB_DECLS), NT(NT_BLOCK5), END_OF_RULE}},
+  {NT_SUB_DECLS, {NT(NT_FUNC_DECL), NT(NT_SUB_DECLS), END_OF_RULE}},
+  {NT_SUB_DECLS, {NT(NT_PROC_DECL), NT(NT_SUB_DECLS), END_OF_RULE}},
+  {NT_SUB_DECLS, {END_OF_RULE}},
+  {NT_FUNC_DECL, {KW_FUNCTION, TK_IDENT, NT(NT_PARAMS), SB_COLON, NT(NT_BASIC_TYPE),
+                  SB_SEMICOLON, NT(NT_BLOCK), SB_SEMICOLON, END_OF_RULE}},
+  {NT_PROC_DECL, {KW_PROCEDURE, TK_IDENT, NT(NT_PARAMS), SB_SEMICOLON, NT(NT_BLOCK),
+                  SB_SEMICOLON, END_OF_RULE}},
+  {NT_BLOCK5, {KW_BEGIN, NT(NT_STATEMENTS), KW_END, END_OF_RULE}},
+
+  {NT_PARAMS, {SB_LPAR, NT(NT_PARAM), NT(NT_PARAMS2), SB_RPAR, END_OF_RULE}},
+  {NT_PARAMS, {END_OF_RULE}},
+  {NT_PARAMS2, {SB_SEMICOLON, NT(NT_PARAM), NT(NT_PARAMS2), END_OF_RULE}},
+  {NT_PARAMS2, {END_OF_RULE}},
+  {NT_PARAM, {TK_IDENT, SB_COLON, NT(NT_BASIC_TYPE), END_OF_RULE}},
+  {NT_PARAM, {KW_VAR, TK_IDENT, SB_COLON, NT(NT_BASIC_TYPE), END_OF_RULE}},
+
+  {NT_UNSIGNED_CONSTANT, {TK_NUMBER, END_OF_RULE}},
+  {NT_UNSIGNED_CONSTANT, {TK_IDENT, END_OF_RULE}},
+  {NT_UNSIGNED_CONSTANT, {TK_CHAR, END_OF_RULE}},
+  {NT_CONSTANT, {SB_PLUS, NT(NT_CONSTANT2), END_OF_RULE}},
+  {NT_CONSTANT, {SB_MINUS, NT(NT_CONSTANT2), END_OF_RULE}},
+  {NT_CONSTANT, {NT(NT_CONSTANT2), END_OF_RULE}},
+  {NT_CONSTANT, {TK_CHAR, END_OF_RULE}},
+  {NT_CONSTANT2, {TK_IDENT, END_OF_RULE}},
+  {NT_CONSTANT2, {TK_NUMBER, END_OF_RULE}},
+
+  {NT_TYPE, {KW_INTEGER, END_OF_RULE}},
+  {NT_TYPE, {KW_CHAR, END_OF_RULE}},
+  {NT_TYPE, {TK_IDENT, END_OF_RULE}},
+  {NT_TYPE, {KW_ARRAY, SB_LSEL, TK_NUMBER, SB_RSEL, KW_OF, NT(NT_TYPE), END_OF_RULE}},
+  {NT_BASIC_TYPE, {KW_INTEGER, END_OF_RULE}},
+  {NT_BASIC_TYPE, {KW_CHAR, END_OF_RULE}},
+
+  {NT_STATEMENTS, {NT(NT_STATEMENT), NT(NT_STATEMENTS2), END_OF_RULE}},
+  {NT_STATEMENTS2, {SB_SEMICOLON, NT(NT_STATEMENT), NT(NT_STATEMENTS2), END_OF_RULE}},
+  {NT_STATEMENTS2, {END_OF_RULE}},
+  {NT_STATEMENT, {NT(NT_ASSIGN_ST), END_OF_RULE}},
+  {NT_STATEMENT, {NT(NT_CALL_ST), END_OF_RULE}},
+  {NT_STATEMENT, {NT(NT_GROUP_ST), END_OF_RULE}},
+  {NT_STATEMENT, {NT(NT_IF_ST), END_OF_RULE}},
+  {NT_STATEMENT, {NT(NT_WHILE_ST), END_OF_RULE}},
+  {NT_STATEMENT, {NT(NT_FOR_ST), END_OF_RULE}},
+  {NT_STATEMENT, {END_OF_RULE}},
+  {NT_ASSIGN_ST, {NT(NT_LVALUE), SB_ASSIGN, NT(NT_EXPRESSION), END_OF_RULE}},
+  {NT_LVALUE, {TK_IDENT, NT(NT_INDEXES), END_OF_RULE}},
+  {NT_CALL_ST, {KW_CALL, TK_IDENT, NT(NT_ARGUMENTS), END_OF_RULE}},
+  {NT_GROUP_ST, {KW_BEGIN, NT(NT_STATEMENTS), KW_END, END_OF_RULE}},
+  {NT_IF_ST, {KW_IF, NT(NT_CONDITION), KW_THEN, NT(NT_STATEMENT), NT(NT_ELSE_ST), END_OF_RULE}},
+  {NT_ELSE_ST, {KW_ELSE, NT(NT_STATEMENT), END_OF_RULE}},
+  {NT_ELSE_ST, {END_OF_RULE}},
+  {NT_WHILE_ST, {KW_WHILE, NT(NT_CONDITION), KW_DO, NT(NT_STATEMENT), END_OF_RULE}},
+  {NT_FOR_ST, {KW_FOR, TK_IDENT, SB_ASSIGN, NT(NT_EXPRESSION), KW_TO, NT(NT_EXPRESSION),
+               KW_DO, NT(NT_STATEMENT), END_OF_RULE}},
+
+  {NT_ARGUMENTS, {SB_LPAR, NT(NT_EXPRESSION), NT(NT_ARGUMENTS2), SB_RPAR, END_OF_RULE}},
+  {NT_ARGUMENTS, {END_OF_RULE}},
+  {NT_ARGUMENTS2, {SB_COMMA, NT(NT_EXPRESSION), NT(NT_ARGUMENTS2), END_OF_RULE}},
+  {NT_ARGUMENTS2, {END_OF_RULE}},
+
+  {NT_CONDITION, {NT(NT_EXPRESSION), NT(NT_CONDITION2), END_OF_RULE}},
+  {NT_CONDITION2, {SB_EQ, NT(NT_EXPRESSION), END_OF_RULE}},
+  {NT_CONDITION2, {SB_NEQ, NT(NT_EXPRESSION), END_OF_RULE}},
+  {NT_CONDITION2, {SB_LE, NT(NT_EXPRESSION), END_OF_RULE}},
+  {NT_CONDITION2, {SB_LT, NT(NT_EXPRESSION), END_OF_RULE}},
+  {NT_CONDITION2, {SB_GE, NT(NT_EXPRESSION), END_OF_RULE}},
+  {NT_CONDITION2, {SB_GT, NT(NT_EXPRESSION), END_OF_RULE}},
+
+  {NT_EXPRESSION, {SB_PLUS, NT(NT_EXPRESSION2), END_OF_RULE}},
+  {NT_EXPRESSION, {SB_MINUS, NT(NT_EXPRESSION2), END_OF_RULE}},
+  {NT_EXPRESSION, {NT(NT_EXPRESSION2), END_OF_RULE}},
+  {NT_EXPRESSION2, {NT(NT_TERM), NT(NT_EXPRESSION3), END_OF_RULE}},
+  {NT_EXPRESSION3, {SB_PLUS, NT(NT_TERM), NT(NT_EXPRESSION3), END_OF_RULE}},
+  {NT_EXPRESSION3, {SB_MINUS, NT(NT_TERM), NT(NT_EXPRESSION3), END_OF_RULE}},
+  {NT_EXPRESSION3, {END_OF_RULE}},
+  {NT_TERM, {NT(NT_FACTOR), NT(NT_TERM2), END_OF_RULE}},
+  {NT_TERM2, {SB_TIMES, NT(NT_FACTOR), NT(NT_TERM2), END_OF_RULE}},
+  {NT_TERM2, {SB_SLASH, NT(NT_FACTOR), NT(NT_TERM2), END_OF_RULE}},
+  {NT_TERM2, {END_OF_RULE}},
+  {NT_FACTOR, {TK_NUMBER, END_OF_RULE}},
+  {NT_FACTOR, {TK_CHAR, END_OF_RULE}},
+  {NT_FACTOR, {TK_IDENT, NT(NT_INDEXES), END_OF_RULE}},
+  {NT_FACTOR, {TK_IDENT, NT(NT_ARGUMENTS), END_OF_RULE}},
+  {NT_INDEXES, {SB_LSEL, NT(NT_EXPRESSION), SB_RSEL, NT(NT_INDEXES), END_OF_RULE}},
+  {NT_INDEXES, {END_OF_RULE}}
+};
+
+#define NUM_RULES ((int) (sizeof(rules) / sizeof(rules[0])))
+
+TokenSet firstSets[NUM_NONTERMINALS];
+TokenSet followSets[NUM_NONTERMINALS];
+int nullable[NUM_NONTERMINALS];
+
+static int grammarReady = 0;
+
+// FIRST of rhs[from..], and whether all of it can derive the empty string
+static TokenSet firstOfSequence(const int *rhs, int from, int *allNullable) {
+  TokenSet set = 0;
+  int i;
+
+  for (i = from; rhs[i] != END_OF_RULE; i++) {
+    if (!IS_NT(rhs[i])) {
+      *allNullable = 0;
+      return set | TOKEN_BIT(rhs[i]);
+    }
+    set |= firstSets[rhs[i] - NT_BASE];
+    if (!nullable[rhs[i] - NT_BASE]) {
+      *allNullable = 0;
+      return set;
+    }
+  }
+  *allNullable = 1;
+  return set;
+}
+
+// The usual fixed points: first nullability and FIRST sets, then the
+// FOLLOW sets, with TK_EOF following the program
+void initGrammar(void) {
+  TokenSet set;
+  int changed, allNullable;
+  int r, i, nt;
+
+  if (grammarReady) return;
+
+  for (nt = 0; nt < NUM_NONTERMINALS; nt++) {
+    firstSets[nt] = followSets[nt] = 0;
+    nullable[nt] = 0;
+  }
+
+  do {
+    changed = 0;
+    for (r = 0; r < NUM_RULES; r++) {
+      nt = rules[r].lhs;
+      set = firstSets[nt] | firstOfSequence(rules[r].rhs, 0, &allNullable);
+      if (set != firstSets[nt]) {
+        firstSets[nt] = set;
+        changed = 1;
+      }
+      if (allNullable && !nullable[nt]) {
+        nullable[nt] = 1;
+        changed = 1;
+      }
+    }
+  } while (changed);
+
+  followSets[NT_PROGRAM] = TOKEN_BIT(TK_EOF);
+  do {
+    changed = 0;
+    for (r = 0; r < NUM_RULES; r++)
+      for (i = 0; rules[r].rhs[i] != END_OF_RULE; i++) {
+        if (!IS_NT(rules[r].rhs[i])) continue;
+        nt = rules[r].rhs[i] - NT_BASE;
+        set = firstOfSequence(rules[r].rhs, i + 1, &allNullable);
+        if (allNullable)
+          set |= followSets[rules[r].lhs];
+        if ((followSets[nt] | set) != followSets[nt]) {
+          followSets[nt] |= set;
+          changed = 1;
+        }
+      }
+  } while (changed);
+
+  grammarReady = 1;
+}
@@ -0,0 +1,50 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __GRAMMAR_H__
+#define __GRAMMAR_H__
+
+#include "token.h"
+
+// A set of token types, one bit per TokenType (there are fewer than 64)
+typedef unsigned long long TokenSet;
+
+#define TOKEN_BIT(tokenType) (1ULL << (tokenType))
+#define IN_TOKEN_SET(set, tokenType) (((set) & TOKEN_BIT(tokenType)) != 0)
+
+// The nonterminals of the KPL grammar in grammar.c, one per parsing
+// function of the parser or per tail of a list
+typedef enum {
+  NT_PROGRAM,
+  NT_BLOCK, NT_CONST_DECLS, NT_CONST_DECL,
+  NT_BLOCK2, NT_TYPE_DECLS, NT_TYPE_DECL,
+  NT_BLOCK3, NT_VAR_DECLS, NT_VAR_DECL,
+  NT_BLOCK4, NT_SUB_DECLS, NT_FUNC_DECL, NT_PROC_DECL,
+  NT_BLOCK5,
+  NT_PARAMS, NT_PARAMS2, NT_PARAM,
+  NT_UNSIGNED_CONSTANT, NT_CONSTANT, NT_CONSTANT2,
+  NT_TYPE, NT_BASIC_TYPE,
+  NT_STATEMENTS, NT_STATEMENTS2, NT_STATEMENT,
+  NT_ASSIGN_ST, NT_LVALUE, NT_CALL_ST, NT_GROUP_ST,
+  NT_IF_ST, NT_ELSE_ST, NT_WHILE_ST, NT_FOR_ST,
+  NT_ARGUMENTS, NT_ARGUMENTS2,
+  NT_CONDITION, NT_CONDITION2,
+  NT_EXPRESSION, NT_EXPRESSION2, NT_EXPRESSION3,
+  NT_TERM, NT_TERM2, NT_FACTOR, NT_INDEXES,
+  NUM_NONTERMINALS
+} Nonterminal;
+
+// Filled in by initGrammar() from the grammar rules
+extern TokenSet firstSets[NUM_NONTERMINALS];
+extern TokenSet followSets[NUM_NONTERMINALS];
+extern int nullable[NUM_NONTERMINALS];
+
+#define IN_FIRST(nt, tokenType) IN_TOKEN_SET(firstSets[nt], tokenType)
+#define IN_FOLLOW(nt, tokenType) IN_TOKEN_SET(followSets[nt], tokenType)
+
+void initGrammar(void);
+
+#endif
@@ -6,21 +6,71 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "reader.h"
 #include "parser.h"
 
+extern int reportSymtabMemory;
+extern int pretokenize;
+extern int lexThreads;
+extern int useTokenCache;
+extern int pipelineScan;
+extern int maxErrors;
+extern int buildAst;
+extern int bodyThreads;
+
 /******************************************************************/
 
 int main(int argc, char *argv[]) {
-  if (argc <= 1) {
+  int tokensOnly = 0;
+  int status;
+  int i = 1;
+
+  while ((i < argc) && (argv[i][0] == '-')) {
+    if (strcmp(argv[i], "-m") == 0)
+      reportSymtabMemory = 1;
+    else if (strcmp(argv[i], "-p") == 0)
+      pretokenize = 1;
+    else if ((strcmp(argv[i], "-j") == 0) && (i + 1 < argc) && (atoi(argv[i + 1]) > 0)) {
+      pretokenize = 1;
+      lexThreads = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-c") == 0) {
+      pretokenize = 1;
+      useTokenCache = 1;
+    }
+    else if (strcmp(argv[i], "-t") == 0)
+      tokensOnly = 1;
+    else if (strcmp(argv[i], "-q") == 0)
+      pipelineScan = 1;
+    else if (strcmp(argv[i], "-a") == 0)
+      buildAst = 1;
+    else if ((strcmp(argv[i], "-P") == 0) && (i + 1 < argc) && (atoi(argv[i + 1]) > 0)) {
+      pretokenize = 1;
+      bodyThreads = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i], "-e") == 0) && (i + 1 < argc) && (atoi(argv[i + 1]) >= 0))
+      maxErrors = atoi(argv[++i]);
+    else {
+      printf("parser: unknown option %s\n", argv[i]);
+      return -1;
+    }
+    i ++;
+  }
+
+  if (i >= argc) {
     printf("parser: no input file.\n");
     return -1;
   }
 
-  if (compile(argv[1]) == IO_ERROR) {
+  status = tokensOnly ? dumpTokens(argv[i]) : compile(argv[i]);
+  if (status == IO_ERROR) {
     printf("Can\'t read input file!\n");
     return -1;
+  } else if (status == IO_TOO_LARGE) {
+    printf("Input file too large!\n");
+    return -1;
   }
     
   return 0;
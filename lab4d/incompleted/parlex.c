@@ -0,0 +1,249 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "parlex.h"
+#include "scanner.h"
+#include "atom.h"
+
+// Tokens lexed from some position on, with where each lexeme ends. A
+// lexeme depends only on the position nextLexeme() is called at, so two
+// runs that are called at the same position agree from there on.
+typedef struct {
+  TokenStream tokens;
+  unsigned int *ends;
+  int endsCapacity;
+} LexRun;
+
+// A chunk [from, to) of the text. Nobody knows yet whether from lies
+// in a comment, so the chunk is lexed both ways: run starts at from as
+// if outside a comment and goes on until a lexeme reaches to;
+// commentRun starts as if inside one and stops as soon as it is called
+// at a position run is called at too, from where run is taken over
+// (joinIndex, -1 if that never happens). Identifiers are interned into
+// the chunk's own atoms and renumbered when the chunks are joined.
+typedef struct {
+  const char *text;
+  size_t length;
+  size_t from;
+  size_t to;
+  LexRun run;
+  LexRun commentRun;
+  int joinIndex;
+  AtomTable atoms;
+} LexChunk;
+
+static void initLexRun(LexRun *run) {
+  initTokenStream(&run->tokens);
+  run->ends = NULL;
+  run->endsCapacity = 0;
+}
+
+static void freeLexRun(LexRun *run) {
+  freeTokenStream(&run->tokens);
+  free(run->ends);
+  run->ends = NULL;
+  run->endsCapacity = 0;
+}
+
+static void appendToRun(LexRun *run, Lexeme *lex) {
+  appendLexeme(&run->tokens, lex);
+  if (run->tokens.capacity != run->endsCapacity) {
+    run->endsCapacity = run->tokens.capacity;
+    run->ends = (unsigned int*) realloc(run->ends, run->endsCapacity * sizeof(unsigned int));
+  }
+  run->ends[run->tokens.count - 1] = (unsigned int) lex->end;
+}
+
+// Index of the lexeme of run that ends at pos, or -1. Only an
+// unterminated comment and TK_EOF can share an end, the end of the text,
+// which is never looked up.
+static int findEnd(LexRun *run, size_t pos) {
+  int lo = 0, hi = run->tokens.count - 1, mid;
+
+  while (lo <= hi) {
+    mid = (lo + hi) / 2;
+    if (run->ends[mid] == pos) return mid;
+    if (run->ends[mid] < pos) lo = mid + 1;
+    else hi = mid - 1;
+  }
+  return -1;
+}
+
+static void* lexChunk(void *arg) {
+  LexChunk *chunk = (LexChunk*) arg;
+  Lexeme lex;
+  size_t pos = chunk->from;
+  int j = 0;
+
+  reserveTokens(&chunk->run.tokens, (chunk->to - chunk->from) / 4 + 1);
+  do {
+    nextLexeme(chunk->text, chunk->length, pos, &lex);
+    evaluateLexemeIn(chunk->text, &lex, &chunk->atoms);
+    appendToRun(&chunk->run, &lex);
+    pos = lex.end;
+  } while ((lex.tokenType != TK_EOF) && (pos < chunk->to));
+
+  chunk->joinIndex = -1;
+  if (chunk->from == 0) return NULL;
+
+  pos = chunk->from;
+  do {
+    if (pos == chunk->from)
+      nextLexemeInComment(chunk->text, chunk->length, pos, &lex);
+    else
+      nextLexeme(chunk->text, chunk->length, pos, &lex);
+    evaluateLexemeIn(chunk->text, &lex, &chunk->atoms);
+    appendToRun(&chunk->commentRun, &lex);
+    pos = lex.end;
+
+    while ((j < chunk->run.tokens.count) && (chunk->run.ends[j] < pos))
+      j ++;
+    if ((j < chunk->run.tokens.count) && (chunk->run.ends[j] == pos)) {
+      chunk->joinIndex = j + 1;
+      break;
+    }
+  } while ((lex.tokenType != TK_EOF) && (pos < chunk->to));
+  return NULL;
+}
+
+// Appends entries [first, last) of a chunk run, renumbering identifiers
+// into the global atoms in order of first use, as tokenizeText() would
+static void takeTokens(TokenStream *stream, LexChunk *chunk, LexRun *run,
+                       int first, int last, int *atomMap) {
+  TokenStream *tokens = &run->tokens;
+  int i, n = stream->count;
+  KplInt atom;
+
+  if (last <= first) return;
+  reserveTokens(stream, n + (last - first));
+  memcpy(stream->types + n, tokens->types + first, last - first);
+  memcpy(stream->offsets + n, tokens->offsets + first, (last - first) * sizeof(unsigned int));
+  for (i = first; i < last; i++, n++) {
+    atom = tokens->values[i];
+    if (tokens->types[i] == TK_IDENT) {
+      if (atomMap[atom] < 0)
+        atomMap[atom] = internAtom(chunk->atoms.names[atom], strlen(chunk->atoms.names[atom]));
+      atom = atomMap[atom];
+    }
+    stream->values[n] = atom;
+  }
+  stream->count = n;
+}
+
+void tokenizeTextParallel(TokenStream *stream, const char *text, size_t length, int threads) {
+  LexChunk *chunks;
+  LexChunk *chunk;
+  LexRun *run;
+  pthread_t *workers;
+  int *started;
+  int *atomMap;
+  Lexeme lex;
+  size_t pos;
+  int n = threads, k, i, done;
+
+  if ((size_t) n > length / PARLEX_MIN_CHUNK)
+    n = (int) (length / PARLEX_MIN_CHUNK);
+  if (n <= 1) {
+    tokenizeText(stream, text, length);
+    return;
+  }
+
+  // The transition table is built lazily; do it before anyone races
+  buildTransitions();
+
+  chunks = (LexChunk*) calloc(n, sizeof(LexChunk));
+  workers = (pthread_t*) malloc(n * sizeof(pthread_t));
+  started = (int*) calloc(n, sizeof(int));
+  for (k = 0; k < n; k++) {
+    chunk = &chunks[k];
+    chunk->text = text;
+    chunk->length = length;
+    chunk->from = length / n * k;
+    chunk->to = (k == n - 1) ? length : length / n * (k + 1);
+    initLexRun(&chunk->run);
+    initLexRun(&chunk->commentRun);
+    chunk->atoms = (AtomTable) ATOM_TABLE_INIT;
+  }
+  // A chunk whose thread cannot be started is lexed here
+  for (k = 1; k < n; k++) {
+    started[k] = (pthread_create(&workers[k], NULL, lexChunk, &chunks[k]) == 0);
+    if (!started[k])
+      lexChunk(&chunks[k]);
+  }
+  lexChunk(&chunks[0]);
+  for (k = 1; k < n; k++)
+    if (started[k])
+      pthread_join(workers[k], NULL);
+
+  // Join the chunks in order. pos is where the real scan calls
+  // nextLexeme() next: a chunk is taken over from the first lexeme of
+  // its runs called there, and until that happens the scan is redone
+  // here. A chunk that the scan has gone past is skipped.
+  reserveTokens(stream, stream->count + length / 4 + 1);
+  pos = 0;
+  done = 0;
+  for (k = 0; (k < n) && !done; k++) {
+    chunk = &chunks[k];
+    atomMap = (int*) malloc((chunk->atoms.count + 1) * sizeof(int));
+    memset(atomMap, -1, (chunk->atoms.count + 1) * sizeof(int));
+
+    while (pos < length) {
+      run = NULL;
+      if ((chunk->from > 0) && ((i = findEnd(&chunk->commentRun, pos)) >= 0)) {
+        takeTokens(stream, chunk, &chunk->commentRun, i + 1, chunk->commentRun.tokens.count, atomMap);
+        run = &chunk->commentRun;
+        if (chunk->joinIndex >= 0) {
+          takeTokens(stream, chunk, &chunk->run, chunk->joinIndex, chunk->run.tokens.count, atomMap);
+          run = &chunk->run;
+        }
+      } else if (pos == chunk->from) {
+        takeTokens(stream, chunk, &chunk->run, 0, chunk->run.tokens.count, atomMap);
+        run = &chunk->run;
+      } else if ((i = findEnd(&chunk->run, pos)) >= 0) {
+        takeTokens(stream, chunk, &chunk->run, i + 1, chunk->run.tokens.count, atomMap);
+        run = &chunk->run;
+      }
+      if (run != NULL) {
+        pos = run->ends[run->tokens.count - 1];
+        done = (stream->types[stream->count - 1] == TK_EOF);
+        break;
+      }
+
+      if (pos >= chunk->run.ends[chunk->run.tokens.count - 1])
+        break;
+      nextLexeme(text, length, pos, &lex);
+      evaluateLexeme(text, &lex);
+      appendLexeme(stream, &lex);
+      pos = lex.end;
+      if (lex.tokenType == TK_EOF) {
+        done = 1;
+        break;
+      }
+    }
+    free(atomMap);
+  }
+
+  // The runs stop short of TK_EOF after a comment left open
+  while (!done) {
+    nextLexeme(text, length, pos, &lex);
+    evaluateLexeme(text, &lex);
+    appendLexeme(stream, &lex);
+    pos = lex.end;
+    done = (lex.tokenType == TK_EOF);
+  }
+
+  for (k = 0; k < n; k++) {
+    freeLexRun(&chunks[k].run);
+    freeLexRun(&chunks[k].commentRun);
+    freeAtomTable(&chunks[k].atoms);
+  }
+  free(chunks);
+  free(workers);
+  free(started);
+}
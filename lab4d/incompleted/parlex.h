@@ -0,0 +1,22 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __PARLEX_H__
+#define __PARLEX_H__
+
+#include <stddef.h>
+#include "tokenstream.h"
+
+// Chunks smaller than this are not worth a thread of their own
+#ifndef PARLEX_MIN_CHUNK
+#define PARLEX_MIN_CHUNK (512 * 1024)
+#endif
+
+// Same result as tokenizeText(), atom ids included, but the text is cut
+// into up to threads chunks that are lexed concurrently.
+void tokenizeTextParallel(TokenStream *stream, const char *text, size_t length, int threads);
+
+#endif
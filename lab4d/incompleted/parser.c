@@ -5,47 +5,810 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "reader.h"
 #include "scanner.h"
+#include "tokenstream.h"
+#include "parlex.h"
+#include "tokcache.h"
+#include "tokenqueue.h"
+#include "atom.h"
+#include "grammar.h"
+#include "ast.h"
 #include "parser.h"
 #include "semantics.h"
 #include "error.h"
 #include "debug.h"
 
-Token *currentToken;
-Token *lookAhead;
+// Each thread that parses has its own tokens (see parseBody())
+_Thread_local Token *currentToken;
+
+// Set by kplc -m: report the symbol table's memory use on stderr
+int reportSymtabMemory = 0;
+
+// Set by kplc -p: lex the whole input into tokenStream before parsing
+int pretokenize = 0;
+// Set by kplc -j: number of threads that lex the input for pretokenize
+int lexThreads = 1;
+// Set by kplc -c: replay the tokens from the cache next to the input
+// file when the input has not changed, and write the cache otherwise
+int useTokenCache = 0;
+char *tokenCachePath = NULL;
+// Set by kplc -q: scan on a thread of its own, ahead of the parser
+int pipelineScan = 0;
+// Set by kplc -a: build the syntax tree of the program into ast
+int buildAst = 0;
+Ast ast = AST_INIT;
+// Set by kplc -P: threads that parse the routine bodies, the main one
+// included (see deferBody())
+int bodyThreads = 1;
+TokenStream tokenStream;
+_Thread_local int streamIndex;
+// The stream ends after the token at streamLimit for the parser
+static _Thread_local int streamLimit = INT_MAX;
+
+extern const char *inputBuffer;
+extern size_t inputLength;
 
 extern Type* intType;
 extern Type* charType;
-extern SymTab* symtab;
+extern _Thread_local SymTab* symtab;
 
-void scan(void) {
-  Token* tmp = currentToken;
-  currentToken = lookAhead;
-  lookAhead = getValidToken();
-  free(tmp);
+extern _Thread_local sigjmp_buf *errorRecovery;
+
+Token* nextToken(void) {
+  if (pretokenize) {
+    if (streamIndex > streamLimit)
+      return makeTokenAt(TK_EOF, tokenStream.offsets[streamLimit + 1]);
+    return getStreamToken(&tokenStream, &streamIndex);
+  }
+  if (pipelineScan)
+    return getQueuedToken();
+  return getValidToken();
+}
+
+/******************************************************************/
+// Tokens read ahead of the parser. peek(1) is the next token and peek(k)
+// the k-th, for k up to LOOKAHEAD_SIZE; advance() moves past peek(1),
+// which becomes currentToken. The ring holds the tokens the scanner
+// returned, which stay valid while no more than TOKEN_RING_SIZE of them
+// are held, currentToken included.
+
+#define LOOKAHEAD_SIZE 4            // a power of 2
+
+#if LOOKAHEAD_SIZE >= TOKEN_RING_SIZE
+#error "LOOKAHEAD_SIZE must be below TOKEN_RING_SIZE"
+#endif
+
+static _Thread_local Token *lookAheadRing[LOOKAHEAD_SIZE];
+static _Thread_local unsigned int lookAheadFirst = 0;
+static _Thread_local int lookAheadCount = 0;
+
+// Past LOOKAHEAD_SIZE the ring would overwrite the tokens not read yet
+__attribute__((noinline, noreturn)) static void peekOutOfRange(int k) {
+  fprintf(stderr, "peek(%d): only 1 to %d tokens can be read ahead\n", k, LOOKAHEAD_SIZE);
+  abort();
+}
+
+// Inlined even in the unoptimised build: the parser peeks at every step
+__attribute__((always_inline)) inline Token* peek(int k) {
+  if (__builtin_expect((k < 1) || (k > LOOKAHEAD_SIZE), 0))
+    peekOutOfRange(k);
+  while (lookAheadCount < k) {
+    lookAheadRing[(lookAheadFirst + lookAheadCount) & (LOOKAHEAD_SIZE - 1)] = nextToken();
+    lookAheadCount ++;
+  }
+  return lookAheadRing[(lookAheadFirst + k - 1) & (LOOKAHEAD_SIZE - 1)];
+}
+
+// peek(1) is read as soon as the token before it is consumed, so that
+// its lexical errors come out where they always have
+void advance(void) {
+  currentToken = peek(1);
+  lookAheadFirst = (lookAheadFirst + 1) & (LOOKAHEAD_SIZE - 1);
+  lookAheadCount --;
+  peek(1);
+}
+
+// Forgets the tokens read ahead, for the token source has been moved
+static void restartTokens(void) {
+  lookAheadCount = 0;
+  peek(1);
 }
 
 void eat(TokenType tokenType) {
-  if (lookAhead->tokenType == tokenType) {
-    scan();
-  } else missingToken(tokenType, lookAhead->lineNo, lookAhead->colNo);
+  if (peek(1)->tokenType == tokenType) {
+    advance();
+  } else missingToken(tokenType, peek(1)->lineNo, peek(1)->colNo);
+}
+
+/******************************************************************/
+// Syntax tree construction. With buildAst set, a compile function opens
+// a node for the construct it parses and closes it once the construct
+// is checked; the nodes opened in between become its children. Without
+// it these do nothing.
+
+static AstIndex beginNode(AstKind kind) {
+  return buildAst ? openAstNode(&ast, kind, peek(1)->offset) : AST_NONE;
+}
+
+// For an operator in peek(1), over the operand parsed before it
+static AstIndex beginOperator(AstKind kind) {
+  AstIndex node;
+
+  if (!buildAst) return AST_NONE;
+  node = wrapAstNode(&ast, kind);
+  AST_NODE(&ast, node)->op = peek(1)->tokenType;
+  return node;
+}
+
+static void endNode(AstIndex node, Object *object, Type *type) {
+  if (node == AST_NONE) return;
+  AST_NODE(&ast, node)->object = object;
+  AST_NODE(&ast, node)->type = type;
+  closeAstNode(&ast, currentToken->offset);
+}
+
+// An empty statement takes the place of the token before it
+static void emptyNode(void) {
+  if (!buildAst) return;
+  openAstNode(&ast, AST_EMPTY, currentToken->offset);
+  closeAstNode(&ast, currentToken->offset);
+}
+
+static void setNodeKind(AstIndex node, AstKind kind) {
+  if (node != AST_NONE) AST_NODE(&ast, node)->kind = kind;
+}
+
+static void setNodeOp(AstIndex node, TokenType op) {
+  if (node != AST_NONE) AST_NODE(&ast, node)->op = op;
+}
+
+static void setNodeValue(AstIndex node, KplInt value) {
+  if (node != AST_NONE) AST_NODE(&ast, node)->value = value;
+}
+
+/******************************************************************/
+// Panic mode error recovery. A statement, a declaration or a subroutine
+// arms a recovery point while it is parsed; an error inside it jumps
+// back there, and the parser skips to a token that may follow it and
+// goes on. Points nest, the innermost one takes the error.
+
+typedef struct RecoveryPoint_ {
+  sigjmp_buf env;
+  sigjmp_buf *outer;
+  Scope *scope;
+  int astDepth;
+} RecoveryPoint;
+
+#define OPENING_TOKENS (TOKEN_BIT(KW_BEGIN) | TOKEN_BIT(SB_LPAR) | TOKEN_BIT(SB_LSEL))
+#define CLOSING_TOKENS (TOKEN_BIT(KW_END) | TOKEN_BIT(SB_RPAR) | TOKEN_BIT(SB_RSEL))
+
+static void armRecovery(RecoveryPoint *point) {
+  point->outer = errorRecovery;
+  point->scope = symtab->currentScope;
+  point->astDepth = ast.depth;
+  errorRecovery = &point->env;
+}
+
+static void disarmRecovery(RecoveryPoint *point) {
+  errorRecovery = point->outer;
+}
+
+// Called after the jump back: leaves the scopes and the syntax tree
+// nodes the error left open
+static void resumeAt(RecoveryPoint *point) {
+  errorRecovery = &point->env;
+  symtab->currentScope = point->scope;
+  unwindAst(&ast, point->astDepth);
+}
+
+// Skips tokens up to one in stopSet, or the end of the input. A bracketed
+// run, from BEGIN to END, "(" to ")" or "(." to ".)", is skipped as a
+// whole, so that the stop tokens inside it do not count.
+static void skipTo(TokenSet stopSet) {
+  int depth = 0;
+
+  while (peek(1)->tokenType != TK_EOF) {
+    if ((depth == 0) && IN_TOKEN_SET(stopSet, peek(1)->tokenType))
+      return;
+    if (IN_TOKEN_SET(OPENING_TOKENS, peek(1)->tokenType))
+      depth ++;
+    else if ((depth > 0) && IN_TOKEN_SET(CLOSING_TOKENS, peek(1)->tokenType))
+      depth --;
+    advance();
+  }
+}
+
+// After a bad declaration: on to its ";" or to the next section
+static void skipDeclaration(Nonterminal declarations) {
+  skipTo(TOKEN_BIT(SB_SEMICOLON) | followSets[declarations]);
+  if (peek(1)->tokenType == SB_SEMICOLON)
+    advance();
+}
+
+/******************************************************************/
+// Parallel routine bodies (kplc -P). The main thread parses the routines
+// of the program up to their headers only: the block of each is matched
+// by BEGIN and END in the token stream and left as a job. Once the main
+// program is parsed, a pool of threads parses and checks the blocks.
+// Each works on a SymTab of its own, where the program scope shows what
+// was declared before the block and nothing after. The errors of every
+// thread are held back and printed at the end, in source order.
+
+typedef struct {
+  Object *owner;
+  int first;               // stream index of the block's first token
+  int last;                // stream index of the ";" after the block
+  int visible;             // objects of the program scope the block sees
+  unsigned int offset;     // position of the first token
+  int lineNo;
+  int colNo;
+  ErrorReport *errors;
+  int errorsCount;
+  int stopped;             // the compiler would have stopped at the last error
+  unsigned long long key;  // of the routine in an edit session, 0 if none
+  int length;
+  DependencyList dependencies;
+} BodyJob;
+
+typedef struct {
+  ErrorReport report;
+  int order;
+} HeldError;
+
+static int deferBodies = 0;
+static BodyJob *bodyJobs = NULL;
+static int bodyJobsCount = 0;
+static int bodyJobsCapacity = 0;
+static atomic_int nextBodyJob;
+static SymTab *programSymtab;
+
+// Set by reuseRoutine() for the routine being declared in an edit session
+static unsigned long long routineKey = 0;
+static int routineLength;
+
+// Matches the blocks still open at stream index i, the blocks of the
+// routines declared from i on included (blocks is 0 from the FUNCTION or
+// PROCEDURE of a routine). Returns the index of the ";" after the last
+// one, or -1 if it cannot be made out.
+static int findBlockEnd(int i, int blocks) {
+  unsigned char *types = tokenStream.types;
+  int depth = 0;
+
+  do {
+    switch (types[i ++]) {
+    case TK_EOF:
+      return -1;
+    case KW_FUNCTION:
+    case KW_PROCEDURE:
+      if (depth == 0) blocks ++;
+      break;
+    case KW_BEGIN:
+      depth ++;
+      break;
+    case KW_END:
+      if (depth == 0) return -1;
+      if (-- depth == 0) blocks --;
+      break;
+    default:
+      break;
+    }
+  } while (blocks > 0);
+  while (types[i] == TK_NONE)
+    i ++;
+  return (types[i] == SB_SEMICOLON) ? i : -1;
+}
+
+// Called with peek(1) on the first token of the block of owner, a
+// routine of the program. Returns 0 if the end of the block cannot be
+// made out, and the block is then parsed as usual.
+static int deferBody(Object *owner) {
+  int first = streamIndex - 1;     // peek(1) is the only token read ahead
+  int i;
+  BodyJob *job;
+
+  if (peek(1)->tokenType == TK_EOF) return 0;
+
+  i = findBlockEnd(first, 1);
+  if (i < 0) return 0;
+
+  if (bodyJobsCount == bodyJobsCapacity) {
+    bodyJobsCapacity = (bodyJobsCapacity == 0) ? 64 : bodyJobsCapacity * 2;
+    bodyJobs = (BodyJob*) realloc(bodyJobs, bodyJobsCapacity * sizeof(BodyJob));
+  }
+  job = &bodyJobs[bodyJobsCount ++];
+  job->owner = owner;
+  job->first = first;
+  job->last = i;
+  job->visible = symtab->currentScope->outer->objCount;
+  job->offset = peek(1)->offset;
+  job->lineNo = peek(1)->lineNo;
+  job->colNo = peek(1)->colNo;
+  job->errors = NULL;
+  job->errorsCount = 0;
+  job->stopped = 0;
+  job->key = routineKey;
+  job->length = routineLength;
+  memset(&job->dependencies, 0, sizeof(DependencyList));
+  job->dependencies.routine = owner;
+  routineKey = 0;
+
+  streamIndex = i;
+  restartTokens();
+  eat(SB_SEMICOLON);
+  return 1;
+}
+
+// The block of a routine and the ";" after it
+static void compileRoutineBody(Object *owner) {
+  if (deferBodies && (symtab->currentScope->outer == symtab->program->progAttrs->scope) &&
+      deferBody(owner))
+    return;
+  compileBlock();
+  eat(SB_SEMICOLON);
+}
+
+static void parseBody(BodyJob *job) {
+  SymTab table = *programSymtab;
+  RecoveryPoint point;
+  sigjmp_buf stop;
+
+  symtab = &table;
+  if (job->owner->kind == OBJ_FUNCTION)
+    enterBlock(job->owner->funcAttrs->scope);
+  else enterBlock(job->owner->procAttrs->scope);
+  setScopeSnapshot(table.program->progAttrs->scope, job->visible);
+
+  seekLocation(job->offset, job->lineNo, job->colNo);
+  streamIndex = job->first;
+  streamLimit = job->last;
+  currentToken = NULL;
+  if (job->key != 0)
+    recordDependencies(&job->dependencies);
+
+  deferErrors(&stop);
+  if (sigsetjmp(stop, 0) == 0) {
+    restartTokens();
+    armRecovery(&point);
+    if (sigsetjmp(point.env, 0) == 0) {
+      compileBlock();
+      eat(SB_SEMICOLON);
+    } else {
+      // The rest of the block is given up, but for its lexical errors
+      resumeAt(&point);
+      while (peek(1)->tokenType != TK_EOF)
+        advance();
+    }
+    disarmRecovery(&point);
+  } else job->stopped = 1;
+  deferErrors(NULL);
+  job->errors = takeErrors(&job->errorsCount);
+
+  recordDependencies(NULL);
+  setScopeSnapshot(NULL, 0);
+  streamLimit = INT_MAX;
+  symtab = programSymtab;
+}
+
+// slot is the thread's symbol table arena, or -1 for the main thread
+static void* parseBodies(void *slot) {
+  int k;
+
+  if ((intptr_t) slot >= 0)
+    useThreadArena((int) (intptr_t) slot);
+  while ((k = atomic_fetch_add(&nextBodyJob, 1)) < bodyJobsCount)
+    parseBody(&bodyJobs[k]);
+  return NULL;
+}
+
+static void parseDeferredBodies(void) {
+  pthread_t threads[MAX_SYMTAB_THREADS];
+  int started[MAX_SYMTAB_THREADS];
+  int n = bodyThreads - 1;
+  int i;
+
+  if (n > MAX_SYMTAB_THREADS) n = MAX_SYMTAB_THREADS;
+  if (n > bodyJobsCount - 1) n = bodyJobsCount - 1;
+
+  programSymtab = symtab;
+  atomic_store(&nextBodyJob, 0);
+  // A thread that cannot be started leaves its share to the others
+  for (i = 0; i < n; i++)
+    started[i] = (pthread_create(&threads[i], NULL, parseBodies, (void*) (intptr_t) i) == 0);
+  parseBodies((void*) (intptr_t) -1);
+  for (i = 0; i < n; i++)
+    if (started[i])
+      pthread_join(threads[i], NULL);
+}
+
+static int compareHeldErrors(const void *a, const void *b) {
+  const HeldError *x = (const HeldError*) a;
+  const HeldError *y = (const HeldError*) b;
+
+  if (x->report.lineNo != y->report.lineNo)
+    return x->report.lineNo - y->report.lineNo;
+  if (x->report.colNo != y->report.colNo)
+    return x->report.colNo - y->report.colNo;
+  return x->order - y->order;
+}
+
+static void holdErrors(HeldError *held, int *count, ErrorReport *errors, int errorsCount) {
+  int i;
+
+  for (i = 0; i < errorsCount; i++) {
+    held[*count].report = errors[i];
+    held[*count].order = *count;
+    (*count) ++;
+  }
+  free(errors);
+}
+
+// Keeps in stop the earlier of itself and the last of errors
+static void noteStop(HeldError *stop, int *stopped, ErrorReport *errors, int errorsCount, int order) {
+  HeldError last;
+
+  if (errorsCount == 0) return;
+  last.report = errors[errorsCount - 1];
+  last.order = order;
+  if (!*stopped || (compareHeldErrors(&last, stop) < 0)) {
+    *stop = last;
+    *stopped = 1;
+  }
+}
+
+// Reports the errors of all the threads in source order, up to the first
+// one the compiler would have stopped at. They are printed, or only kept
+// in the error list if print is 0. Returns 1 if the compiler would have
+// stopped.
+static int reportHeldErrors(ErrorReport *mainErrors, int mainCount, int mainStopped, int print) {
+  HeldError *held;
+  HeldError stop;
+  sigjmp_buf full;
+  int stopped = 0;
+  int total = mainCount;
+  int count = 0;
+  int i;
+
+  for (i = 0; i < bodyJobsCount; i++)
+    total += bodyJobs[i].errorsCount;
+  if (total == 0) return 0;
+
+  // Every error at the stop position is printed, hence its order
+  if (mainStopped)
+    noteStop(&stop, &stopped, mainErrors, mainCount, total);
+  for (i = 0; i < bodyJobsCount; i++)
+    if (bodyJobs[i].stopped)
+      noteStop(&stop, &stopped, bodyJobs[i].errors, bodyJobs[i].errorsCount, total);
+
+  held = (HeldError*) malloc(total * sizeof(HeldError));
+  holdErrors(held, &count, mainErrors, mainCount);
+  for (i = 0; i < bodyJobsCount; i++)
+    holdErrors(held, &count, bodyJobs[i].errors, bodyJobs[i].errorsCount);
+  qsort(held, count, sizeof(HeldError), compareHeldErrors);
+
+  // Printed, the errors stop the compiler at the cap themselves
+  if (!print) {
+    deferErrors(&full);
+    if (sigsetjmp(full, 0) != 0) {
+      deferErrors(NULL);
+      free(held);
+      return 1;
+    }
+  }
+  for (i = 0; i < count; i++) {
+    if (stopped && (compareHeldErrors(&held[i], &stop) > 0)) break;
+    replayError(&held[i].report);
+  }
+  if (!print)
+    deferErrors(NULL);
+  free(held);
+  return stopped;
+}
+
+static void keepKnownRoutines(void);
+
+// Returns 1 if the compiler would have stopped
+static int compileProgramDeferred(int print) {
+  sigjmp_buf stop;
+  ErrorReport *errors;
+  int errorsCount;
+  int stopped = 0;
+
+  deferErrors(&stop);
+  if (sigsetjmp(stop, 0) == 0)
+    compileProgram();
+  else stopped = 1;
+  deferErrors(NULL);
+  errors = takeErrors(&errorsCount);
+
+  parseDeferredBodies();
+  stopped = reportHeldErrors(errors, errorsCount, stopped, print);
+  keepKnownRoutines();
+
+  free(bodyJobs);
+  bodyJobs = NULL;
+  bodyJobsCount = bodyJobsCapacity = 0;
+  return stopped;
+}
+
+static void compileProgramInParallel(void) {
+  if (compileProgramDeferred(1))
+    exit(0);
+}
+
+/******************************************************************/
+// Edit sessions, for an editor that compiles the program again after
+// every change. The session keeps the token stream, the atoms and the
+// symbol table from one compile to the next, as well as the routines of
+// the program that compiled without errors, keyed by a hash of their
+// tokens from FUNCTION or PROCEDURE to the final ";". The program is
+// compiled as with kplc -P, but for a routine whose tokens hash to a
+// known key: the routine of the last compile is declared again, without
+// parsing, as long as each object its body looked up in the program
+// scope or among the builtins still has the same signature. Only the
+// routines that were edited, or that use a declaration that changed,
+// are parsed and checked again.
+
+typedef struct {
+  unsigned long long key;        // 0 for an empty slot
+  int length;                    // tokens
+  Object *routine;
+  DependencyList dependencies;
+} KnownRoutine;
+
+// Open addressing, at most half full
+typedef struct {
+  KnownRoutine *slots;
+  int size;                      // a power of 2
+  int count;
+} RoutineTable;
+
+// The symbol table is compiled afresh once it has grown this many times
+// over since the last time, the routines given up along the way with it
+#define EDIT_SYMTAB_GROWTH 4
+
+static int editSession = 0;
+static RoutineTable knownRoutines;         // from the last compile
+static RoutineTable nextRoutines;          // from this one
+static EditStats editStats;
+static size_t editSymtabBytes;
+
+static void initRoutineTable(RoutineTable *table, int expected) {
+  table->size = 64;
+  while (table->size < 2 * expected)
+    table->size *= 2;
+  table->slots = (KnownRoutine*) calloc(table->size, sizeof(KnownRoutine));
+  table->count = 0;
+}
+
+static void freeRoutineTable(RoutineTable *table) {
+  int i;
+
+  for (i = 0; i < table->size; i++)
+    free(table->slots[i].dependencies.items);
+  free(table->slots);
+  table->slots = NULL;
+  table->size = table->count = 0;
+}
+
+static KnownRoutine *findKnownRoutine(RoutineTable *table, unsigned long long key, int length) {
+  int h;
+
+  if (table->slots == NULL) return NULL;
+  for (h = key & (table->size - 1); table->slots[h].key != 0; h = (h + 1) & (table->size - 1))
+    if ((table->slots[h].key == key) && (table->slots[h].length == length))
+      return &table->slots[h];
+  return NULL;
+}
+
+// The table takes dependencies over
+static void addKnownRoutine(RoutineTable *table, unsigned long long key, int length,
+                            Object *routine, DependencyList *dependencies) {
+  RoutineTable grown;
+  KnownRoutine *slot;
+  int h, i;
+
+  if (2 * (table->count + 1) > table->size) {
+    initRoutineTable(&grown, table->count + 1);
+    for (i = 0; i < table->size; i++)
+      if (table->slots[i].key != 0) {
+        slot = &table->slots[i];
+        addKnownRoutine(&grown, slot->key, slot->length, slot->routine, &slot->dependencies);
+      }
+    free(table->slots);
+    *table = grown;
+  }
+
+  for (h = key & (table->size - 1); table->slots[h].key != 0; h = (h + 1) & (table->size - 1))
+    ;
+  slot = &table->slots[h];
+  slot->key = key;
+  slot->length = length;
+  slot->routine = routine;
+  slot->dependencies = *dependencies;
+  dependencies->items = NULL;
+  dependencies->count = dependencies->capacity = 0;
+  table->count ++;
+}
+
+// 0 if the tokens hold a lexical error, whose report would be lost
+static unsigned long long hashTokens(int first, int last) {
+  unsigned long long h = 14695981039346656037ull;
+  int i;
+
+  for (i = first; i <= last; i++) {
+    if (tokenStream.types[i] == TK_NONE) return 0;
+    h = (h ^ tokenStream.types[i]) * 1099511628211ull;
+    h = (h ^ (unsigned long long) tokenStream.values[i]) * 1099511628211ull;
+  }
+  return (h == 0) ? 1 : h;
+}
+
+static unsigned long long currentSignature(char *name) {
+  Object *obj = findScopeObject(symtab->program->progAttrs->scope, name);
+
+  if (obj == NULL)
+    obj = findObject(symtab->globalObjectList, name);
+  return (obj == NULL) ? 0 : objectSignature(obj);
+}
+
+// Called with peek(1) on the FUNCTION or PROCEDURE of a routine of the
+// program. Declares the routine of the last compile and skips its tokens
+// if they did not change, nor did what its body looked up.
+static int reuseRoutine(void) {
+  int first = streamIndex - 1;
+  int last = findBlockEnd(first, 0);
+  Scope *scope = symtab->currentScope;
+  KnownRoutine *known;
+  Object *routine;
+  int i;
+
+  routineKey = 0;
+  if (last < 0) return 0;
+  routineKey = hashTokens(first, last);
+  routineLength = last - first + 1;
+  if (routineKey == 0) return 0;
+
+  known = findKnownRoutine(&knownRoutines, routineKey, routineLength);
+  if ((known == NULL) || (findScopeObject(scope, known->routine->name) != NULL))
+    return 0;
+  for (i = 0; i < known->dependencies.count; i++)
+    if (currentSignature(known->dependencies.items[i].name) != known->dependencies.items[i].signature)
+      return 0;
+
+  routine = known->routine;
+  declareObject(routine);
+  if (routine->kind == OBJ_FUNCTION)
+    routine->funcAttrs->scope->outer = scope;
+  else routine->procAttrs->scope->outer = scope;
+  addKnownRoutine(&nextRoutines, known->key, known->length, routine, &known->dependencies);
+  editStats.reused ++;
+
+  routineKey = 0;
+  streamIndex = last + 1;
+  restartTokens();
+  return 1;
+}
+
+static int compareDependencies(const void *a, const void *b) {
+  const Dependency *x = (const Dependency*) a;
+  const Dependency *y = (const Dependency*) b;
+
+  if (x->name != y->name)
+    return (x->name < y->name) ? -1 : 1;
+  return 0;
+}
+
+// Names are atoms: a name looked up many times is kept once
+static void uniqueDependencies(DependencyList *list) {
+  int i, n = 0;
+
+  if (list->count < 2) return;
+  qsort(list->items, list->count, sizeof(Dependency), compareDependencies);
+  for (i = 0; i < list->count; i++)
+    if ((n == 0) || (list->items[n - 1].name != list->items[i].name))
+      list->items[n ++] = list->items[i];
+  list->count = n;
+}
+
+// The routines parsed by this compile become known if they have no
+// errors; the others are forgotten
+static void keepKnownRoutines(void) {
+  BodyJob *job;
+  int i;
+
+  for (i = 0; i < bodyJobsCount; i++) {
+    job = &bodyJobs[i];
+    if (editSession && (job->key != 0) && (job->errorsCount == 0) && !job->stopped) {
+      uniqueDependencies(&job->dependencies);
+      addKnownRoutine(&nextRoutines, job->key, job->length, job->owner, &job->dependencies);
+    }
+    free(job->dependencies.items);
+  }
+  if (editSession)
+    editStats.parsed = bodyJobsCount;
+}
+
+static void compileEdit(void) {
+  editStats.reused = editStats.parsed = 0;
+  clearErrors();
+  initRoutineTable(&nextRoutines, knownRoutines.count);
+
+  symtab->program = NULL;
+  streamIndex = 0;
+  currentToken = NULL;
+  restartTokens();
+  deferBodies = 1;
+  compileProgramDeferred(0);
+  deferBodies = 0;
+
+  freeRoutineTable(&knownRoutines);
+  knownRoutines = nextRoutines;
+  nextRoutines.slots = NULL;
+}
+
+EditStats openEditSession(const char *text, size_t length) {
+  closeEditSession();
+  openInputBuffer(text, length);
+  initTokenStream(&tokenStream);
+  tokenizeText(&tokenStream, text, length);
+  initSymTab();
+  initGrammar();
+
+  pretokenize = 1;
+  buildAst = 0;
+  editSession = 1;
+  compileEdit();
+  editSymtabBytes = symtabBytesUsed();
+  return editStats;
+}
+
+EditStats updateEditSession(const char *text, size_t length,
+                            size_t offset, size_t deleted, size_t inserted) {
+  openInputBuffer(text, length);
+  relexEdit(&tokenStream, text, length, offset, deleted, inserted);
+
+  if (symtabBytesUsed() > EDIT_SYMTAB_GROWTH * editSymtabBytes) {
+    freeRoutineTable(&knownRoutines);
+    cleanSymTab();
+    initSymTab();
+    compileEdit();
+    editSymtabBytes = symtabBytesUsed();
+  } else compileEdit();
+  return editStats;
+}
+
+void closeEditSession(void) {
+  if (!editSession) return;
+  freeRoutineTable(&knownRoutines);
+  cleanSymTab();
+  freeTokenStream(&tokenStream);
+  freeAtoms();
+  closeInputStream();
+  editSession = 0;
 }
 
 void compileProgram(void) {
   Object* program;
+  AstIndex node = beginNode(AST_PROGRAM);
 
   eat(KW_PROGRAM);
   eat(TK_IDENT);
 
-  program = createProgramObject(currentToken->string);
+  program = createProgramObject(currentToken->ident);
   enterBlock(program->progAttrs->scope);
 
   eat(SB_SEMICOLON);
 
   compileBlock();
   eat(SB_PERIOD);
+  endNode(node, program, NULL);
 
   exitBlock();
 }
@@ -53,24 +816,35 @@ void compileProgram(void) {
 void compileBlock(void) {
   Object* constObj;
   ConstantValue* constValue;
+  RecoveryPoint point;
+  AstIndex node;
 
-  if (lookAhead->tokenType == KW_CONST) {
+  if (peek(1)->tokenType == KW_CONST) {
     eat(KW_CONST);
 
     do {
-      eat(TK_IDENT);
+      armRecovery(&point);
+      if (sigsetjmp(point.env, 0) == 0) {
+        node = beginNode(AST_CONST_DECL);
+        eat(TK_IDENT);
       
-      checkFreshIdent(currentToken->string);
-      constObj = createConstantObject(currentToken->string);
+        checkFreshIdent(currentToken->ident);
+        constObj = createConstantObject(currentToken->ident);
       
-      eat(SB_EQ);
-      constValue = compileConstant();
+        eat(SB_EQ);
+        constValue = compileConstant();
       
-      constObj->constAttrs->value = constValue;
-      declareObject(constObj);
+        constObj->constAttrs->value = constValue;
+        declareObject(constObj);
       
-      eat(SB_SEMICOLON);
-    } while (lookAhead->tokenType == TK_IDENT);
+        eat(SB_SEMICOLON);
+        endNode(node, constObj, NULL);
+      } else {
+        resumeAt(&point);
+        skipDeclaration(NT_CONST_DECLS);
+      }
+      disarmRecovery(&point);
+    } while (peek(1)->tokenType == TK_IDENT);
 
     compileBlock2();
   } 
@@ -80,24 +854,35 @@ void compileBlock(void) {
 void compileBlock2(void) {
   Object* typeObj;
   Type* actualType;
+  RecoveryPoint point;
+  AstIndex node;
 
-  if (lookAhead->tokenType == KW_TYPE) {
+  if (peek(1)->tokenType == KW_TYPE) {
     eat(KW_TYPE);
 
     do {
-      eat(TK_IDENT);
+      armRecovery(&point);
+      if (sigsetjmp(point.env, 0) == 0) {
+        node = beginNode(AST_TYPE_DECL);
+        eat(TK_IDENT);
       
-      checkFreshIdent(currentToken->string);
-      typeObj = createTypeObject(currentToken->string);
+        checkFreshIdent(currentToken->ident);
+        typeObj = createTypeObject(currentToken->ident);
       
-      eat(SB_EQ);
-      actualType = compileType();
+        eat(SB_EQ);
+        actualType = compileType();
       
-      typeObj->typeAttrs->actualType = actualType;
-      declareObject(typeObj);
+        typeObj->typeAttrs->actualType = actualType;
+        declareObject(typeObj);
       
-      eat(SB_SEMICOLON);
-    } while (lookAhead->tokenType == TK_IDENT);
+        eat(SB_SEMICOLON);
+        endNode(node, typeObj, actualType);
+      } else {
+        resumeAt(&point);
+        skipDeclaration(NT_TYPE_DECLS);
+      }
+      disarmRecovery(&point);
+    } while (peek(1)->tokenType == TK_IDENT);
 
     compileBlock3();
   } 
@@ -107,24 +892,35 @@ void compileBlock2(void) {
 void compileBlock3(void) {
   Object* varObj;
   Type* varType;
+  RecoveryPoint point;
+  AstIndex node;
 
-  if (lookAhead->tokenType == KW_VAR) {
+  if (peek(1)->tokenType == KW_VAR) {
     eat(KW_VAR);
 
     do {
-      eat(TK_IDENT);
+      armRecovery(&point);
+      if (sigsetjmp(point.env, 0) == 0) {
+        node = beginNode(AST_VAR_DECL);
+        eat(TK_IDENT);
       
-      checkFreshIdent(currentToken->string);
-      varObj = createVariableObject(currentToken->string);
+        checkFreshIdent(currentToken->ident);
+        varObj = createVariableObject(currentToken->ident);
 
-      eat(SB_COLON);
-      varType = compileType();
+        eat(SB_COLON);
+        varType = compileType();
       
-      varObj->varAttrs->type = varType;
-      declareObject(varObj);
+        varObj->varAttrs->type = varType;
+        declareObject(varObj);
       
-      eat(SB_SEMICOLON);
-    } while (lookAhead->tokenType == TK_IDENT);
+        eat(SB_SEMICOLON);
+        endNode(node, varObj, varType);
+      } else {
+        resumeAt(&point);
+        skipDeclaration(NT_VAR_DECLS);
+      }
+      disarmRecovery(&point);
+    } while (peek(1)->tokenType == TK_IDENT);
 
     compileBlock4();
   } 
@@ -137,28 +933,49 @@ void compileBlock4(void) {
 }
 
 void compileBlock5(void) {
+  AstIndex node = beginNode(AST_COMPOUND);
+
   eat(KW_BEGIN);
   compileStatements();
   eat(KW_END);
+  endNode(node, NULL, NULL);
 }
 
+// A subroutine the parser cannot make sense of is skipped up to the end
+// of the first block after the error and the ";" after it
 void compileSubDecls(void) {
-  while ((lookAhead->tokenType == KW_FUNCTION) || (lookAhead->tokenType == KW_PROCEDURE)) {
-    if (lookAhead->tokenType == KW_FUNCTION)
-      compileFuncDecl();
-    else compileProcDecl();
+  RecoveryPoint point;
+
+  while ((peek(1)->tokenType == KW_FUNCTION) || (peek(1)->tokenType == KW_PROCEDURE)) {
+    if (editSession && (symtab->currentScope == symtab->program->progAttrs->scope) &&
+        reuseRoutine())
+      continue;
+    armRecovery(&point);
+    if (sigsetjmp(point.env, 0) == 0) {
+      if (peek(1)->tokenType == KW_FUNCTION)
+        compileFuncDecl();
+      else compileProcDecl();
+    } else {
+      resumeAt(&point);
+      skipTo(firstSets[NT_BLOCK5]);
+      skipTo(followSets[NT_BLOCK]);
+      if (peek(1)->tokenType == SB_SEMICOLON)
+        advance();
+    }
+    disarmRecovery(&point);
   }
 }
 
 void compileFuncDecl(void) {
   Object* funcObj;
   Type* returnType;
+  AstIndex node = beginNode(AST_FUNCTION);
 
   eat(KW_FUNCTION);
   eat(TK_IDENT);
 
-  checkFreshIdent(currentToken->string);
-  funcObj = createFunctionObject(currentToken->string);
+  checkFreshIdent(currentToken->ident);
+  funcObj = createFunctionObject(currentToken->ident);
   declareObject(funcObj);
 
   enterBlock(funcObj->funcAttrs->scope);
@@ -170,20 +987,21 @@ void compileFuncDecl(void) {
   funcObj->funcAttrs->returnType = returnType;
 
   eat(SB_SEMICOLON);
-  compileBlock();
-  eat(SB_SEMICOLON);
+  compileRoutineBody(funcObj);
+  endNode(node, funcObj, returnType);
 
   exitBlock();
 }
 
 void compileProcDecl(void) {
   Object* procObj;
+  AstIndex node = beginNode(AST_PROCEDURE);
 
   eat(KW_PROCEDURE);
   eat(TK_IDENT);
 
-  checkFreshIdent(currentToken->string);
-  procObj = createProcedureObject(currentToken->string);
+  checkFreshIdent(currentToken->ident);
+  procObj = createProcedureObject(currentToken->ident);
   declareObject(procObj);
 
   enterBlock(procObj->procAttrs->scope);
@@ -191,8 +1009,8 @@ void compileProcDecl(void) {
   compileParams();
 
   eat(SB_SEMICOLON);
-  compileBlock();
-  eat(SB_SEMICOLON);
+  compileRoutineBody(procObj);
+  endNode(node, procObj, NULL);
 
   exitBlock();
 }
@@ -201,7 +1019,7 @@ ConstantValue* compileUnsignedConstant(void) {
   ConstantValue* constValue;
   Object* obj;
 
-  switch (lookAhead->tokenType) {
+  switch (peek(1)->tokenType) {
   case TK_NUMBER:
     eat(TK_NUMBER);
     constValue = makeIntConstant(currentToken->value);
@@ -209,7 +1027,7 @@ ConstantValue* compileUnsignedConstant(void) {
   case TK_IDENT:
     eat(TK_IDENT);
 
-    obj = checkDeclaredConstant(currentToken->string);
+    obj = checkDeclaredConstant(currentToken->ident);
     constValue = duplicateConstantValue(obj->constAttrs->value);
 
     break;
@@ -218,7 +1036,7 @@ ConstantValue* compileUnsignedConstant(void) {
     constValue = makeCharConstant(currentToken->string[0]);
     break;
   default:
-    error(ERR_INVALID_CONSTANT, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_CONSTANT, peek(1)->lineNo, peek(1)->colNo);
     break;
   }
   return constValue;
@@ -227,7 +1045,7 @@ ConstantValue* compileUnsignedConstant(void) {
 ConstantValue* compileConstant(void) {
   ConstantValue* constValue;
 
-  switch (lookAhead->tokenType) {
+  switch (peek(1)->tokenType) {
   case SB_PLUS:
     eat(SB_PLUS);
     constValue = compileConstant2();
@@ -252,21 +1070,21 @@ ConstantValue* compileConstant2(void) {
   ConstantValue* constValue;
   Object* obj;
 
-  switch (lookAhead->tokenType) {
+  switch (peek(1)->tokenType) {
   case TK_NUMBER:
     eat(TK_NUMBER);
     constValue = makeIntConstant(currentToken->value);
     break;
   case TK_IDENT:
     eat(TK_IDENT);
-    obj = checkDeclaredConstant(currentToken->string);
+    obj = checkDeclaredConstant(currentToken->ident);
     if (obj->constAttrs->value->type == TP_INT)
       constValue = duplicateConstantValue(obj->constAttrs->value);
     else
       error(ERR_UNDECLARED_INT_CONSTANT,currentToken->lineNo, currentToken->colNo);
     break;
   default:
-    error(ERR_INVALID_CONSTANT, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_CONSTANT, peek(1)->lineNo, peek(1)->colNo);
     break;
   }
   return constValue;
@@ -278,7 +1096,7 @@ Type* compileType(void) {
   int arraySize;
   Object* obj;
 
-  switch (lookAhead->tokenType) {
+  switch (peek(1)->tokenType) {
   case KW_INTEGER: 
     eat(KW_INTEGER);
     type =  makeIntType();
@@ -292,6 +1110,9 @@ Type* compileType(void) {
     eat(SB_LSEL);
     eat(TK_NUMBER);
 
+    // Sizes are ints, whatever KplInt is
+    if (currentToken->value > INT_MAX)
+      error(ERR_NUMBER_TOO_LARGE, currentToken->lineNo, currentToken->colNo);
     arraySize = currentToken->value;
 
     eat(SB_RSEL);
@@ -301,11 +1122,11 @@ Type* compileType(void) {
     break;
   case TK_IDENT:
     eat(TK_IDENT);
-    obj = checkDeclaredType(currentToken->string);
-    type = duplicateType(obj->typeAttrs->actualType);
+    obj = checkDeclaredType(currentToken->ident);
+    type = obj->typeAttrs->actualType;
     break;
   default:
-    error(ERR_INVALID_TYPE, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_TYPE, peek(1)->lineNo, peek(1)->colNo);
     break;
   }
   return type;
@@ -314,7 +1135,7 @@ Type* compileType(void) {
 Type* compileBasicType(void) {
   Type* type;
 
-  switch (lookAhead->tokenType) {
+  switch (peek(1)->tokenType) {
   case KW_INTEGER: 
     eat(KW_INTEGER); 
     type = makeIntType();
@@ -324,17 +1145,17 @@ Type* compileBasicType(void) {
     type = makeCharType();
     break;
   default:
-    error(ERR_INVALID_BASICTYPE, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_BASICTYPE, peek(1)->lineNo, peek(1)->colNo);
     break;
   }
   return type;
 }
 
 void compileParams(void) {
-  if (lookAhead->tokenType == SB_LPAR) {
+  if (peek(1)->tokenType == SB_LPAR) {
     eat(SB_LPAR);
     compileParam();
-    while (lookAhead->tokenType == SB_SEMICOLON) {
+    while (peek(1)->tokenType == SB_SEMICOLON) {
       eat(SB_SEMICOLON);
       compileParam();
     }
@@ -346,8 +1167,9 @@ void compileParam(void) {
   Object* param;
   Type* type;
   enum ParamKind paramKind;
+  AstIndex node = beginNode(AST_PARAM);
 
-  switch (lookAhead->tokenType) {
+  switch (peek(1)->tokenType) {
   case TK_IDENT:
     paramKind = PARAM_VALUE;
     break;
@@ -356,29 +1178,40 @@ void compileParam(void) {
     paramKind = PARAM_REFERENCE;
     break;
   default:
-    error(ERR_INVALID_PARAMETER, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_PARAMETER, peek(1)->lineNo, peek(1)->colNo);
     break;
   }
 
   eat(TK_IDENT);
-  checkFreshIdent(currentToken->string);
-  param = createParameterObject(currentToken->string, paramKind, symtab->currentScope->owner);
+  checkFreshIdent(currentToken->ident);
+  param = createParameterObject(currentToken->ident, paramKind, symtab->currentScope->owner);
   eat(SB_COLON);
   type = compileBasicType();
   param->paramAttrs->type = type;
   declareObject(param);
+  endNode(node, param, type);
 }
 
 void compileStatements(void) {
   compileStatement();
-  while (lookAhead->tokenType == SB_SEMICOLON) {
+  while (peek(1)->tokenType == SB_SEMICOLON) {
     eat(SB_SEMICOLON);
     compileStatement();
   }
 }
 
 void compileStatement(void) {
-  switch (lookAhead->tokenType) {
+  RecoveryPoint point;
+
+  armRecovery(&point);
+  if (sigsetjmp(point.env, 0) != 0) {
+    resumeAt(&point);
+    skipTo(followSets[NT_STATEMENT]);
+    disarmRecovery(&point);
+    return;
+  }
+
+  switch (peek(1)->tokenType) {
   case TK_IDENT:
     compileAssignSt();
     break;
@@ -398,25 +1231,24 @@ void compileStatement(void) {
     compileForSt();
     break;
     // EmptySt needs to check FOLLOW tokens
-  case SB_SEMICOLON:
-  case KW_END:
-  case KW_ELSE:
-    break;
-    // Error occurs
   default:
-    error(ERR_INVALID_STATEMENT, lookAhead->lineNo, lookAhead->colNo);
+    if (!IN_FOLLOW(NT_STATEMENT, peek(1)->tokenType))
+      error(ERR_INVALID_STATEMENT, peek(1)->lineNo, peek(1)->colNo);
+    emptyNode();
     break;
   }
+  disarmRecovery(&point);
 }
 
 Type* compileLValue(void) {
   // parse a lvalue (a variable, an array element, a parameter, the current function identifier)
   Object* var;
   Type* varType;
+  AstIndex node = beginNode(AST_VARIABLE);
 
   eat(TK_IDENT);
   // check if the identifier is a function identifier, or a variable identifier, or a parameter
-  var = checkDeclaredLValueIdent(currentToken->string);
+  var = checkDeclaredLValueIdent(currentToken->ident);
 
   switch (var->kind) {
   case OBJ_VARIABLE:
@@ -434,41 +1266,52 @@ Type* compileLValue(void) {
     break;
   }
 
+  endNode(node, var, varType);
   return varType;
 }
 
 void compileAssignSt(void) {
   // parse the assignment and check type consistency
+  AstIndex node = beginNode(AST_ASSIGN);
   Type* lhsType = compileLValue();
   eat(SB_ASSIGN);
   Type* rhsType = compileExpression();
   checkTypeEquality(lhsType, rhsType);
+  endNode(node, NULL, lhsType);
 }
 
 void compileCallSt(void) {
   Object* proc;
+  AstIndex node = beginNode(AST_CALL);
 
   eat(KW_CALL);
   eat(TK_IDENT);
 
-  proc = checkDeclaredProcedure(currentToken->string);
+  proc = checkDeclaredProcedure(currentToken->ident);
 
   compileArguments(proc->procAttrs->paramList);
+  endNode(node, proc, NULL);
 }
 
 void compileGroupSt(void) {
+  AstIndex node = beginNode(AST_COMPOUND);
+
   eat(KW_BEGIN);
   compileStatements();
   eat(KW_END);
+  endNode(node, NULL, NULL);
 }
 
 void compileIfSt(void) {
+  AstIndex node = beginNode(AST_IF);
+
   eat(KW_IF);
   compileCondition();
   eat(KW_THEN);
   compileStatement();
-  if (lookAhead->tokenType == KW_ELSE) 
+  if (peek(1)->tokenType == KW_ELSE) 
     compileElseSt();
+  endNode(node, NULL, NULL);
 }
 
 void compileElseSt(void) {
@@ -477,18 +1320,23 @@ void compileElseSt(void) {
 }
 
 void compileWhileSt(void) {
+  AstIndex node = beginNode(AST_WHILE);
+
   eat(KW_WHILE);
   compileCondition();
   eat(KW_DO);
   compileStatement();
+  endNode(node, NULL, NULL);
 }
 
 void compileForSt(void) {
   // Check type consistency of FOR's variable
+  AstIndex node = beginNode(AST_FOR);
+
   eat(KW_FOR);
   eat(TK_IDENT);
 
-  Object* var = checkDeclaredVariable(currentToken->string);
+  Object* var = checkDeclaredVariable(currentToken->ident);
   Type* varType = var->varAttrs->type;
 
   eat(SB_ASSIGN);
@@ -501,6 +1349,7 @@ void compileForSt(void) {
 
   eat(KW_DO);
   compileStatement();
+  endNode(node, var, NULL);
 }
 
 void compileArgument(Object* param) {
@@ -520,7 +1369,7 @@ void compileArgument(Object* param) {
 void compileArguments(ObjectNode* paramList) {
   // parse a list of arguments, check the consistency of the arguments and the given parameters
   ObjectNode* paramNode = paramList;
-  switch (lookAhead->tokenType) {
+  switch (peek(1)->tokenType) {
   case SB_LPAR:
     eat(SB_LPAR);
     if (paramNode != NULL) {
@@ -529,7 +1378,7 @@ void compileArguments(ObjectNode* paramList) {
     } else {
       compileArgument(NULL);
     }
-    while (lookAhead->tokenType == SB_COMMA) {
+    while (peek(1)->tokenType == SB_COMMA) {
       eat(SB_COMMA);
       if (paramNode != NULL) {
         compileArgument(paramNode->object);
@@ -539,41 +1388,38 @@ void compileArguments(ObjectNode* paramList) {
       }
     }
     if (paramNode != NULL) {
-      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, lookAhead->lineNo, lookAhead->colNo);
+      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, peek(1)->lineNo, peek(1)->colNo);
     }
     eat(SB_RPAR);
     break;
     // Check FOLLOW set 
-  case SB_TIMES:
-  case SB_SLASH:
-  case SB_PLUS:
-  case SB_MINUS:
-  case KW_TO:
-  case KW_DO:
-  case SB_RPAR:
-  case SB_COMMA:
-  case SB_EQ:
-  case SB_NEQ:
-  case SB_LE:
-  case SB_LT:
-  case SB_GE:
-  case SB_GT:
-  case SB_RSEL:
-  case SB_SEMICOLON:
-  case KW_END:
-  case KW_ELSE:
-  case KW_THEN:
-    break;
   default:
-    error(ERR_INVALID_ARGUMENTS, lookAhead->lineNo, lookAhead->colNo);
+    if (!IN_FOLLOW(NT_ARGUMENTS, peek(1)->tokenType))
+      error(ERR_INVALID_ARGUMENTS, peek(1)->lineNo, peek(1)->colNo);
   }
 }
 
+// A bad condition is skipped up to its THEN or DO, so that the rest of
+// the statement is still parsed, but not past the end of the statement
 void compileCondition(void) {
+  RecoveryPoint point;
+
+  armRecovery(&point);
+  if (sigsetjmp(point.env, 0) == 0)
+    compileComparison();
+  else {
+    resumeAt(&point);
+    skipTo(followSets[NT_CONDITION] | followSets[NT_STATEMENT]);
+  }
+  disarmRecovery(&point);
+}
+
+void compileComparison(void) {
   // check the type consistency of LHS and RHS, check the basic type
+  AstIndex node = beginNode(AST_CONDITION);
   Type* lhsType = compileExpression();
 
-  switch (lookAhead->tokenType) {
+  switch (peek(1)->tokenType) {
   case SB_EQ:
     eat(SB_EQ);
     break;
@@ -593,28 +1439,30 @@ void compileCondition(void) {
     eat(SB_GT);
     break;
   default:
-    error(ERR_INVALID_COMPARATOR, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_COMPARATOR, peek(1)->lineNo, peek(1)->colNo);
   }
+  setNodeOp(node, currentToken->tokenType);
 
   Type* rhsType = compileExpression();
   checkTypeEquality(lhsType, rhsType);
   checkBasicType(lhsType);
   checkBasicType(rhsType);
+  endNode(node, NULL, NULL);
 }
 
 Type* compileExpression(void) {
   Type* type;
+  AstIndex node;
   
-  switch (lookAhead->tokenType) {
+  switch (peek(1)->tokenType) {
   case SB_PLUS:
-    eat(SB_PLUS);
-    type = compileExpression2();
-    checkIntType(type);
-    break;
   case SB_MINUS:
-    eat(SB_MINUS);
+    node = beginNode(AST_UNARY);
+    setNodeOp(node, peek(1)->tokenType);
+    advance();
     type = compileExpression2();
     checkIntType(type);
+    endNode(node, NULL, type);
     break;
   default:
     type = compileExpression2();
@@ -636,49 +1484,37 @@ Type* compileExpression2(void) {
 }
 
 
+// The operator chains are parsed by loops rather than one recursive
+// call per operator, so that the stack stays flat however long the
+// chain is. compileExpression3() parses every "+ term" or "- term" that
+// follows the first term and returns the type of the second term (NULL
+// if there is none), which compileExpression2() checks against the
+// first once the whole chain has been read, as the recursive version
+// did on its way back.
 Type* compileExpression3(void) {
-  Type* type1;
-  Type* type2;
-
-  switch (lookAhead->tokenType) {
-  case SB_PLUS:
-    eat(SB_PLUS);
-    type1 = compileTerm();
-    checkIntType(type1);
-    type2 = compileExpression3();
-    if (type2 != NULL)
-      checkIntType(type2);
-    return type1;
-    break;
-  case SB_MINUS:
-    eat(SB_MINUS);
-    type1 = compileTerm();
-    checkIntType(type1);
-    type2 = compileExpression3();
-    if (type2 != NULL)
-      checkIntType(type2);
-    return type1;
-    break;
-    // check the FOLLOW set
-  case KW_TO:
-  case KW_DO:
-  case SB_RPAR:
-  case SB_COMMA:
-  case SB_EQ:
-  case SB_NEQ:
-  case SB_LE:
-  case SB_LT:
-  case SB_GE:
-  case SB_GT:
-  case SB_RSEL:
-  case SB_SEMICOLON:
-  case KW_END:
-  case KW_ELSE:
-  case KW_THEN:
-    return NULL;
-    break;
-  default:
-    error(ERR_INVALID_EXPRESSION, lookAhead->lineNo, lookAhead->colNo);
+  Type* firstType = NULL;
+  Type* type;
+  AstIndex node;
+
+  while (1) {
+    switch (peek(1)->tokenType) {
+    case SB_PLUS:
+    case SB_MINUS:
+      node = beginOperator(AST_BINARY);
+      advance();
+      type = compileTerm();
+      checkIntType(type);
+      if (firstType == NULL)
+        firstType = type;
+      endNode(node, NULL, type);
+      break;
+      // check the FOLLOW set
+    default:
+      if (IN_FOLLOW(NT_EXPRESSION3, peek(1)->tokenType))
+        return firstType;
+      error(ERR_INVALID_EXPRESSION, peek(1)->lineNo, peek(1)->colNo);
+      return NULL;
+    }
   }
 }
 
@@ -690,68 +1526,60 @@ Type* compileTerm(void) {
   return type;
 }
 
+// Each "* factor" or "/ factor" checks its factor and the one before it
 void compileTerm2(Type* prevType) {
-  switch (lookAhead->tokenType) {
-  case SB_TIMES:
-    eat(SB_TIMES);
-    Type* t = compileFactor();
-    checkIntType(t);
-    if (prevType) checkIntType(prevType);
-    compileTerm2(t);
-    break;
-  case SB_SLASH:
-    eat(SB_SLASH);
-    t = compileFactor();
-    checkIntType(t);
-    if (prevType) checkIntType(prevType);
-    compileTerm2(t);
-    break;
-  // check the FOLLOW set
-  case SB_PLUS:
-  case SB_MINUS:
-  case KW_TO:
-  case KW_DO:
-  case SB_RPAR:
-  case SB_COMMA:
-  case SB_EQ:
-  case SB_NEQ:
-  case SB_LE:
-  case SB_LT:
-  case SB_GE:
-  case SB_GT:
-  case SB_RSEL:
-  case SB_SEMICOLON:
-  case KW_END:
-  case KW_ELSE:
-  case KW_THEN:
-    break;
-  default:
-    error(ERR_INVALID_TERM, lookAhead->lineNo, lookAhead->colNo);
+  Type* type;
+  AstIndex node;
+
+  while (1) {
+    switch (peek(1)->tokenType) {
+    case SB_TIMES:
+    case SB_SLASH:
+      node = beginOperator(AST_BINARY);
+      advance();
+      type = compileFactor();
+      checkIntType(type);
+      if (prevType) checkIntType(prevType);
+      prevType = type;
+      endNode(node, NULL, type);
+      break;
+    // check the FOLLOW set
+    default:
+      if (!IN_FOLLOW(NT_TERM2, peek(1)->tokenType))
+        error(ERR_INVALID_TERM, peek(1)->lineNo, peek(1)->colNo);
+      return;
+    }
   }
 }
 
 Type* compileFactor(void) {
   // TODO: parse a factor and return the factor's type
 
-  Object* obj;
+  Object* obj = NULL;
   Type* type;
+  AstIndex node = beginNode(AST_VARIABLE);
 
-  switch (lookAhead->tokenType) {
+  switch (peek(1)->tokenType) {
   case TK_NUMBER:
     eat(TK_NUMBER);
     type = makeIntType();
+    setNodeKind(node, AST_NUMBER);
+    setNodeValue(node, currentToken->value);
     break;
   case TK_CHAR:
     eat(TK_CHAR);
     type = makeCharType();
+    setNodeKind(node, AST_CHAR);
+    setNodeValue(node, currentToken->value);
     break;
   case TK_IDENT:
     eat(TK_IDENT);
     // check if the identifier is declared
-    obj = checkDeclaredIdent(currentToken->string);
+    obj = checkDeclaredIdent(currentToken->ident);
 
     switch (obj->kind) {
     case OBJ_CONSTANT:
+      setNodeKind(node, AST_CONSTANT);
       if (obj->constAttrs == NULL || obj->constAttrs->value == NULL) {
         error(ERR_INVALID_CONSTANT, currentToken->lineNo, currentToken->colNo);
         type = NULL;
@@ -785,6 +1613,7 @@ Type* compileFactor(void) {
         type = NULL;
       } else {
         type = obj->funcAttrs->returnType;
+        setNodeKind(node, AST_CALL);
         compileArguments(obj->funcAttrs->paramList);
       }
       break;
@@ -795,16 +1624,17 @@ Type* compileFactor(void) {
     }
     break;
   default:
-    error(ERR_INVALID_FACTOR, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_FACTOR, peek(1)->lineNo, peek(1)->colNo);
     type = NULL;
     break;
   }
+  endNode(node, obj, type);
   return type;
 }
 
 Type* compileIndexes(Type* arrayType) {
   Type* type = arrayType;
-  while (lookAhead->tokenType == SB_LSEL) {
+  while (peek(1)->tokenType == SB_LSEL) {
     checkArrayType(type);
     eat(SB_LSEL);
     Type* idxType = compileExpression();
@@ -815,24 +1645,117 @@ Type* compileIndexes(Type* arrayType) {
   return type;
 }
 
-int compile(char *fileName) {
-  if (openInputStream(fileName) == IO_ERROR)
-    return IO_ERROR;
+void tokenizeInput(void) {
+  initTokenStream(&tokenStream);
+  if ((tokenCachePath == NULL) ||
+      !loadTokenCache(tokenCachePath, inputBuffer, inputLength, &tokenStream)) {
+    if (lexThreads > 1)
+      tokenizeTextParallel(&tokenStream, inputBuffer, inputLength, lexThreads);
+    else
+      tokenizeText(&tokenStream, inputBuffer, inputLength);
+    if (tokenCachePath != NULL)
+      saveTokenCache(tokenCachePath, inputBuffer, inputLength, &tokenStream);
+  }
+  streamIndex = 0;
+}
 
-  currentToken = NULL;
-  lookAhead = getValidToken();
+void compileInput(void) {
+  clearErrors();
+  if (pretokenize)
+    tokenizeInput();
 
+  // The symbol table interns the names of the builtins, which must be
+  // done before a scanner thread owns the atoms
   initSymTab();
+  initGrammar();
+
+  if (pipelineScan && !pretokenize)
+    startScannerThread(inputBuffer, inputLength);
+  else pipelineScan = 0;
 
-  compileProgram();
+  currentToken = NULL;
+  restartTokens();
+
+  deferBodies = (bodyThreads > 1) && pretokenize && !buildAst;
+  if (deferBodies)
+    compileProgramInParallel();
+  else compileProgram();
+
+  // Only a program without errors has a symbol table worth printing
+  if (errorCount() == 0) {
+    printObject(symtab->program,0);
+    if (buildAst)
+      printAst(&ast, AST_ROOT, 0);
+  }
 
-  printObject(symtab->program,0);
+  if (reportSymtabMemory)
+    fprintf(stderr, "symtab: %lu bytes used, %lu bytes reserved\n",
+            (unsigned long) symtabBytesUsed(), (unsigned long) symtabBytesReserved());
 
+  if (pipelineScan)
+    stopScannerThread();
+  freeAst(&ast);
   cleanSymTab();
+  if (pretokenize)
+    freeTokenStream(&tokenStream);
+  freeAtoms();
 
-  free(currentToken);
-  free(lookAhead);
   closeInputStream();
+}
+
+// NULL for an input that is not a file, which is never cached
+void setTokenCachePath(char *fileName) {
+  free(tokenCachePath);
+  tokenCachePath = NULL;
+  if (useTokenCache && (fileName != NULL)) {
+    tokenCachePath = (char*) malloc(strlen(fileName) + strlen(TOKEN_CACHE_SUFFIX) + 1);
+    sprintf(tokenCachePath, "%s%s", fileName, TOKEN_CACHE_SUFFIX);
+  }
+}
+
+int compile(char *fileName) {
+  int status = openInputStream(fileName);
+
+  if (status != IO_SUCCESS)
+    return status;
+
+  setTokenCachePath(fileName);
+  compileInput();
   return IO_SUCCESS;
+}
+
+// Prints the tokens of a file one per line, as the lab1 scanner does
+int dumpTokens(char *fileName) {
+  Token *token;
+  int status = openInputStream(fileName);
+
+  if (status != IO_SUCCESS)
+    return status;
+
+  setTokenCachePath(fileName);
+  if (pretokenize)
+    tokenizeInput();
+
+  token = nextToken();
+  while (token->tokenType != TK_EOF) {
+    printToken(token);
+    token = nextToken();
+  }
 
+  if (pretokenize)
+    freeTokenStream(&tokenStream);
+  freeAtoms();
+  closeInputStream();
+  return IO_SUCCESS;
+}
+
+int compileBuffer(const char *src, size_t len) {
+  int status = openInputBuffer(src, len);
+
+  if (status != IO_SUCCESS)
+    return status;
+
+  setTokenCachePath(NULL);
+  compileInput();
+  return IO_SUCCESS;
 }
@@ -5,10 +5,13 @@
  */
 #ifndef __PARSER_H__
 #define __PARSER_H__
+#include <stddef.h>
 #include "token.h"
 #include "symtab.h"
 
-void scan(void);
+Token* nextToken(void);
+Token* peek(int k);
+void advance(void);
 void eat(TokenType tokenType);
 
 void compileProgram(void);
@@ -46,6 +49,7 @@ void compileForSt(void);
 void compileArgument(Object* param);
 void compileArguments(ObjectNode* paramList);
 void compileCondition(void);
+void compileComparison(void);
 Type* compileExpression(void);
 Type* compileExpression2(void);
 Type* compileExpression3(void);
@@ -54,6 +58,26 @@ void compileTerm2(Type* prevType);
 Type* compileFactor(void);
 Type* compileIndexes(Type* arrayType);
 
+void tokenizeInput(void);
+void compileInput(void);
+void setTokenCachePath(char *fileName);
 int compile(char *fileName);
+int dumpTokens(char *fileName);
+int compileBuffer(const char *src, size_t len);
+
+// Edit sessions: the program is compiled once by openEditSession(), then
+// again after each change by updateEditSession(), which reuses the
+// routines the change leaves alone. The errors are kept in the error
+// list, not printed; a program without errors has its symbol table in
+// symtab->program. No syntax tree is built.
+typedef struct {
+  int reused;         // routines declared again as they were
+  int parsed;         // routines parsed and checked
+} EditStats;
+
+EditStats openEditSession(const char *text, size_t length);
+EditStats updateEditSession(const char *text, size_t length,
+                            size_t offset, size_t deleted, size_t inserted);
+void closeEditSession(void);
 
 #endif
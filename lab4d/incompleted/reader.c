@@ -1,37 +1,233 @@
-/* 
+/*
  * @copyright (c) 2008, Hedspi, Hanoi University of Technology
  * @author Huu-Duc Nguyen
  * @version 1.0
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include "reader.h"
 
-FILE *inputStream;
-int lineNo, colNo;
+// The whole source text is kept in memory; the scanner walks it through
+// inputPos and currentChar is the byte at inputPos (or EOF past the end).
+const char *inputBuffer;
+size_t inputLength;
+size_t inputPos;
 int currentChar;
 
+enum InputOwnership {
+  INPUT_MAPPED,
+  INPUT_HEAP,
+  INPUT_BORROWED
+};
+
+static enum InputOwnership inputOwnership;
+
+// Last position resolved by locateOffset(); lookups are almost always
+// monotonic, so newlines are only counted once over the whole input.
+// Each thread has its own, so parsing threads can locate their tokens.
+static _Thread_local size_t locOffset = 0;
+static _Thread_local size_t locLineStart = 0;
+static _Thread_local int locLineNo = 1;
+
+static void resetInput(void) {
+  inputPos = 0;
+  locOffset = 0;
+  locLineStart = 0;
+  locLineNo = 1;
+  currentChar = (inputLength > 0) ? (unsigned char) inputBuffer[0] : EOF;
+}
+
+int seekInput(size_t offset) {
+  inputPos = (offset < inputLength) ? offset : inputLength;
+  currentChar = (inputPos < inputLength) ? (unsigned char) inputBuffer[inputPos] : EOF;
+  return currentChar;
+}
+
 int readChar(void) {
-  currentChar = getc(inputStream);
-  colNo ++;
-  if (currentChar == '\n') {
-    lineNo ++;
-    colNo = 0;
+  return seekInput(inputPos + 1);
+}
+
+#if defined(__SSE2__)
+// Compiled for AVX2 whatever the flags, and only run on the processors
+// that have it. Counts the '\n' bytes of the whole 32-byte blocks from
+// *p on, and leaves *p after them.
+__attribute__((target("avx2")))
+static int countNewlines256(const char **p, const char *end) {
+  __m256i nl32 = _mm256_set1_epi8('\n');
+  int count = 0;
+
+  while (end - *p >= 32) {
+    count += __builtin_popcount((unsigned int) _mm256_movemask_epi8(
+               _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) *p), nl32)));
+    *p += 32;
   }
-  return currentChar;
+  // Not done by the compiler without -O: the SSE code after would stall
+  _mm256_zeroupper();
+  return count;
+}
+#endif
+
+// Number of '\n' bytes in [p, end), counted a vector at a time
+static int countNewlines(const char *p, const char *end) {
+  int count = 0;
+
+#if defined(__SSE2__)
+  // Most lookups cover a line or two, too short for AVX2 to pay
+  if ((end - p >= 256) && __builtin_cpu_supports("avx2"))
+    count = countNewlines256(&p, end);
+  __m128i nl16 = _mm_set1_epi8('\n');
+  while (end - p >= 16) {
+    count += __builtin_popcount((unsigned int) _mm_movemask_epi8(
+               _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) p), nl16)));
+    p += 16;
+  }
+#endif
+  while (p < end)
+    count += (*p++ == '\n');
+  return count;
+}
+
+void locateOffset(size_t offset, int *lineNo, int *colNo) {
+  const char *p;
+  const char *nl;
+  int count;
+
+  if (offset > inputLength) offset = inputLength;
+
+  if (offset < locLineStart) {
+    locOffset = 0;
+    locLineStart = 0;
+    locLineNo = 1;
+  }
+
+  if (offset > locOffset) {
+    p = inputBuffer + locOffset;
+    count = countNewlines(p, inputBuffer + offset);
+    if (count > 0) {
+      locLineNo += count;
+      nl = inputBuffer + offset - 1;
+      while (*nl != '\n')
+        nl --;
+      locLineStart = nl + 1 - inputBuffer;
+    }
+    locOffset = offset;
+  }
+
+  *lineNo = locLineNo;
+  *colNo = (int) (offset - locLineStart) + 1;
+}
+
+// Starts the calling thread's lookups at a known position, which saves
+// counting the newlines before it
+void seekLocation(size_t offset, int lineNo, int colNo) {
+  locOffset = offset;
+  locLineStart = offset - (colNo - 1);
+  locLineNo = lineNo;
+}
+
+static int slurpFile(FILE *f) {
+  char *buf = NULL;
+  char *grown;
+  size_t cap = 0, n;
+
+  inputLength = 0;
+  do {
+    if (inputLength == cap) {
+      cap = (cap == 0) ? 65536 : cap * 2;
+      grown = (char*) realloc(buf, cap);
+      if (grown == NULL) {
+        free(buf);
+        return IO_ERROR;
+      }
+      buf = grown;
+    }
+    n = fread(buf + inputLength, 1, cap - inputLength, f);
+    inputLength += n;
+    if (inputLength > MAX_INPUT_LENGTH) {
+      free(buf);
+      return IO_TOO_LARGE;
+    }
+  } while (n > 0);
+
+  inputBuffer = buf;
+  inputOwnership = INPUT_HEAP;
+  return IO_SUCCESS;
 }
 
 int openInputStream(char *fileName) {
-  inputStream = fopen(fileName, "rt");
-  if (inputStream == NULL)
+  struct stat st;
+  FILE *f;
+  void *map;
+  int fd, status;
+
+  fd = open(fileName, O_RDONLY);
+  if (fd < 0)
     return IO_ERROR;
-  lineNo = 1;
-  colNo = 0;
-  readChar();
+
+  if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+    if ((size_t) st.st_size > MAX_INPUT_LENGTH) {
+      close(fd);
+      return IO_TOO_LARGE;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      close(fd);
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+      inputBuffer = map;
+      inputLength = st.st_size;
+      inputOwnership = INPUT_MAPPED;
+      resetInput();
+      return IO_SUCCESS;
+    }
+  }
+
+  // Pipes, empty files or a failed mmap: read everything into the heap
+  f = fdopen(fd, "rb");
+  if (f == NULL) {
+    close(fd);
+    return IO_ERROR;
+  }
+  status = slurpFile(f);
+  fclose(f);
+  if (status == IO_SUCCESS)
+    resetInput();
+  return status;
+}
+
+// The buffer stays owned by the caller and must outlive the scan; it is
+// read in place and does not need to be NUL-terminated.
+int openInputBuffer(const char *buffer, size_t length) {
+  if ((buffer == NULL) && (length > 0))
+    return IO_ERROR;
+  if (length > MAX_INPUT_LENGTH)
+    return IO_TOO_LARGE;
+  inputBuffer = buffer;
+  inputLength = length;
+  inputOwnership = INPUT_BORROWED;
+  resetInput();
   return IO_SUCCESS;
 }
 
 void closeInputStream() {
-  fclose(inputStream);
+  switch (inputOwnership) {
+  case INPUT_MAPPED:
+    munmap((void*) inputBuffer, inputLength);
+    break;
+  case INPUT_HEAP:
+    free((void*) inputBuffer);
+    break;
+  case INPUT_BORROWED:
+    break;
+  }
+  inputBuffer = NULL;
+  inputLength = 0;
 }
-
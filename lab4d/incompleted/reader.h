@@ -1,4 +1,4 @@
-/* 
+/*
  * @copyright (c) 2008, Hedspi, Hanoi University of Technology
  * @author Huu-Duc Nguyen
  * @version 1.0
@@ -7,11 +7,21 @@
 #ifndef __READER_H__
 #define __READER_H__
 
+#include <stddef.h>
+
 #define IO_ERROR 0
 #define IO_SUCCESS 1
+#define IO_TOO_LARGE 2
+
+// Token offsets are 32-bit, so longer inputs are turned down
+#define MAX_INPUT_LENGTH ((size_t) 0xFFFFFFFFu)
 
 int readChar(void);
+int seekInput(size_t offset);
+void locateOffset(size_t offset, int *lineNo, int *colNo);
+void seekLocation(size_t offset, int lineNo, int colNo);
 int openInputStream(char *fileName);
+int openInputBuffer(const char *buffer, size_t length);
 void closeInputStream(void);
 
 #endif
@@ -6,238 +6,428 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #include "reader.h"
 #include "charcode.h"
 #include "token.h"
+#include "atom.h"
 #include "error.h"
 #include "scanner.h"
 
 
-extern int lineNo;
-extern int colNo;
+extern const char *inputBuffer;
+extern size_t inputLength;
+extern size_t inputPos;
 extern int currentChar;
 
 extern CharCode charCodes[];
 
 /***************************************************************/
 
-void skipBlank() {
-  while ((currentChar != EOF) && (charCodes[currentChar] == CHAR_SPACE))
-    readChar();
+// States of the scanning automaton. ST_DONE ends a lexeme without
+// consuming the current character; the token it yields is given by
+// stateInfo[] for the state the automaton stopped in. ST_START and
+// ST_COMMENT come right after ST_DONE so that nextLexeme() can spot all
+// three with a single comparison.
+enum ScanState {
+  ST_DONE,
+  ST_START,
+  ST_COMMENT,
+  ST_IDENT,
+  ST_NUMBER,
+  ST_QUOTE,
+  ST_QUOTE_CHAR,
+  ST_CHAR,
+  ST_PLUS,
+  ST_MINUS,
+  ST_TIMES,
+  ST_SLASH,
+  ST_EQ,
+  ST_COMMA,
+  ST_SEMICOLON,
+  ST_RPAR,
+  ST_LT,
+  ST_LE,
+  ST_GT,
+  ST_GE,
+  ST_EXCLAIMATION,
+  ST_NEQ,
+  ST_COLON,
+  ST_ASSIGN,
+  ST_PERIOD,
+  ST_RSEL,
+  ST_LPAR,
+  ST_LSEL,
+  ST_COMMENT_STAR,
+  ST_UNKNOWN,
+  NUM_SCAN_STATES
+};
+
+#define NUM_CHAR_CLASSES (CHAR_UNKNOWN + 1)
+
+struct StateInfo {
+  TokenType tokenType;
+  int errorCode;
+};
+
+static const struct StateInfo stateInfo[NUM_SCAN_STATES] = {
+  [ST_DONE] = {TK_NONE, LEX_NO_ERROR},
+  [ST_START] = {TK_EOF, LEX_NO_ERROR},
+  [ST_IDENT] = {TK_IDENT, LEX_NO_ERROR},
+  [ST_NUMBER] = {TK_NUMBER, LEX_NO_ERROR},
+  [ST_QUOTE] = {TK_NONE, ERR_INVALID_CONSTANT_CHAR},
+  [ST_QUOTE_CHAR] = {TK_NONE, ERR_INVALID_CONSTANT_CHAR},
+  [ST_CHAR] = {TK_CHAR, LEX_NO_ERROR},
+  [ST_PLUS] = {SB_PLUS, LEX_NO_ERROR},
+  [ST_MINUS] = {SB_MINUS, LEX_NO_ERROR},
+  [ST_TIMES] = {SB_TIMES, LEX_NO_ERROR},
+  [ST_SLASH] = {SB_SLASH, LEX_NO_ERROR},
+  [ST_EQ] = {SB_EQ, LEX_NO_ERROR},
+  [ST_COMMA] = {SB_COMMA, LEX_NO_ERROR},
+  [ST_SEMICOLON] = {SB_SEMICOLON, LEX_NO_ERROR},
+  [ST_RPAR] = {SB_RPAR, LEX_NO_ERROR},
+  [ST_LT] = {SB_LT, LEX_NO_ERROR},
+  [ST_LE] = {SB_LE, LEX_NO_ERROR},
+  [ST_GT] = {SB_GT, LEX_NO_ERROR},
+  [ST_GE] = {SB_GE, LEX_NO_ERROR},
+  [ST_EXCLAIMATION] = {TK_NONE, ERR_INVALID_SYMBOL},
+  [ST_NEQ] = {SB_NEQ, LEX_NO_ERROR},
+  [ST_COLON] = {SB_COLON, LEX_NO_ERROR},
+  [ST_ASSIGN] = {SB_ASSIGN, LEX_NO_ERROR},
+  [ST_PERIOD] = {SB_PERIOD, LEX_NO_ERROR},
+  [ST_RSEL] = {SB_RSEL, LEX_NO_ERROR},
+  [ST_LPAR] = {SB_LPAR, LEX_NO_ERROR},
+  [ST_LSEL] = {SB_LSEL, LEX_NO_ERROR},
+  [ST_COMMENT] = {TK_NONE, ERR_END_OF_COMMENT},
+  [ST_COMMENT_STAR] = {TK_NONE, ERR_END_OF_COMMENT},
+  [ST_UNKNOWN] = {TK_NONE, ERR_INVALID_SYMBOL}
+};
+
+// Transitions indexed by the raw input byte; generated from the
+// transitions over CharCode classes the first time the scanner runs.
+static unsigned char transitions[NUM_SCAN_STATES][256];
+static int transitionsReady = 0;
+static int simdBlanks = 0;
+
+// Blanks checked one by one before skipBlanks() turns to vectors
+#define SCALAR_BLANKS 4
+
+static void setClassTransition(unsigned char classTable[][NUM_CHAR_CLASSES],
+                               int from, CharCode c, int to) {
+  classTable[from][c] = to;
 }
 
-void skipComment() {
-  int state = 0;
-  while ((currentChar != EOF) && (state < 2)) {
-    switch (charCodes[currentChar]) {
-    case CHAR_TIMES:
-      state = 1;
-      break;
-    case CHAR_RPAR:
-      if (state == 1) state = 2;
-      else state = 0;
-      break;
-    default:
-      state = 0;
-    }
-    readChar();
-  }
-  if (state != 2) 
-    error(ERR_END_OF_COMMENT, lineNo, colNo);
+static void setAllClassTransitions(unsigned char classTable[][NUM_CHAR_CLASSES],
+                                   int from, int to) {
+  int c;
+  for (c = 0; c < NUM_CHAR_CLASSES; c++)
+    classTable[from][c] = to;
 }
 
-Token* readIdentKeyword(void) {
-  Token *token = makeToken(TK_NONE, lineNo, colNo);
-  int count = 1;
+void buildTransitions(void) {
+  unsigned char classTable[NUM_SCAN_STATES][NUM_CHAR_CLASSES] = {{ST_DONE}};
+  int s, b;
+
+  setClassTransition(classTable, ST_START, CHAR_SPACE, ST_START);
+  setClassTransition(classTable, ST_START, CHAR_LETTER, ST_IDENT);
+  setClassTransition(classTable, ST_START, CHAR_DIGIT, ST_NUMBER);
+  setClassTransition(classTable, ST_START, CHAR_PLUS, ST_PLUS);
+  setClassTransition(classTable, ST_START, CHAR_MINUS, ST_MINUS);
+  setClassTransition(classTable, ST_START, CHAR_TIMES, ST_TIMES);
+  setClassTransition(classTable, ST_START, CHAR_SLASH, ST_SLASH);
+  setClassTransition(classTable, ST_START, CHAR_LT, ST_LT);
+  setClassTransition(classTable, ST_START, CHAR_GT, ST_GT);
+  setClassTransition(classTable, ST_START, CHAR_EXCLAIMATION, ST_EXCLAIMATION);
+  setClassTransition(classTable, ST_START, CHAR_EQ, ST_EQ);
+  setClassTransition(classTable, ST_START, CHAR_COMMA, ST_COMMA);
+  setClassTransition(classTable, ST_START, CHAR_PERIOD, ST_PERIOD);
+  setClassTransition(classTable, ST_START, CHAR_COLON, ST_COLON);
+  setClassTransition(classTable, ST_START, CHAR_SEMICOLON, ST_SEMICOLON);
+  setClassTransition(classTable, ST_START, CHAR_SINGLEQUOTE, ST_QUOTE);
+  setClassTransition(classTable, ST_START, CHAR_LPAR, ST_LPAR);
+  setClassTransition(classTable, ST_START, CHAR_RPAR, ST_RPAR);
+  setClassTransition(classTable, ST_START, CHAR_UNKNOWN, ST_UNKNOWN);
+
+  setClassTransition(classTable, ST_IDENT, CHAR_LETTER, ST_IDENT);
+  setClassTransition(classTable, ST_IDENT, CHAR_DIGIT, ST_IDENT);
+  setClassTransition(classTable, ST_NUMBER, CHAR_DIGIT, ST_NUMBER);
+
+  setAllClassTransitions(classTable, ST_QUOTE, ST_QUOTE_CHAR);
+  setClassTransition(classTable, ST_QUOTE_CHAR, CHAR_SINGLEQUOTE, ST_CHAR);
+
+  setClassTransition(classTable, ST_LT, CHAR_EQ, ST_LE);
+  setClassTransition(classTable, ST_GT, CHAR_EQ, ST_GE);
+  setClassTransition(classTable, ST_EXCLAIMATION, CHAR_EQ, ST_NEQ);
+  setClassTransition(classTable, ST_COLON, CHAR_EQ, ST_ASSIGN);
+  setClassTransition(classTable, ST_PERIOD, CHAR_RPAR, ST_RSEL);
+  setClassTransition(classTable, ST_LPAR, CHAR_PERIOD, ST_LSEL);
+  setClassTransition(classTable, ST_LPAR, CHAR_TIMES, ST_COMMENT);
+
+  // A comment ends in "*)" and is then skipped like a blank
+  setAllClassTransitions(classTable, ST_COMMENT, ST_COMMENT);
+  setClassTransition(classTable, ST_COMMENT, CHAR_TIMES, ST_COMMENT_STAR);
+  setAllClassTransitions(classTable, ST_COMMENT_STAR, ST_COMMENT);
+  setClassTransition(classTable, ST_COMMENT_STAR, CHAR_TIMES, ST_COMMENT_STAR);
+  setClassTransition(classTable, ST_COMMENT_STAR, CHAR_RPAR, ST_START);
+
+  for (s = 0; s < NUM_SCAN_STATES; s++)
+    for (b = 0; b < 256; b++)
+      transitions[s][b] = classTable[s][charCodes[b]];
+
+  // The vectorised blank skipping below hard-codes the blanks of
+  // charcode.c; fall back to the table if they ever differ
+  simdBlanks = 1;
+  for (b = 0; b < 256; b++)
+    if ((charCodes[b] == CHAR_SPACE) != ((b == ' ') || ((b >= '\t') && (b <= '\r'))))
+      simdBlanks = 0;
+
+  transitionsReady = 1;
+}
 
-  token->string[0] = toupper((char)currentChar);
-  readChar();
+#if defined(__SSE2__)
+// Mask of the bytes of x that are blanks: ' ' or '\t'..'\r'
+static inline __m128i blankMask128(__m128i x) {
+  __m128i d = _mm_sub_epi8(x, _mm_set1_epi8('\t'));
+  __m128i inRange = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8('\r' - '\t')), d);
+  return _mm_or_si128(inRange, _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+}
+#endif
+
+#if defined(__SSE2__)
+// The AVX2 code is compiled whatever the flags, and only run on the
+// processors that have it
+__attribute__((target("avx2")))
+static inline __m256i blankMask256(__m256i x) {
+  __m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8('\t'));
+  __m256i inRange = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8('\r' - '\t')), d);
+  return _mm256_or_si256(inRange, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+}
 
-  while ((currentChar != EOF) && 
-	 ((charCodes[currentChar] == CHAR_LETTER) || (charCodes[currentChar] == CHAR_DIGIT))) {
-    if (count <= MAX_IDENT_LEN) token->string[count++] = toupper((char)currentChar);
-    readChar();
-  }
+// Skips 32 bytes at a time while they are all blanks
+__attribute__((target("avx2")))
+static const unsigned char* skipBlanks256(const unsigned char *p, const unsigned char *end) {
+  unsigned int mask;
 
-  if (count > MAX_IDENT_LEN) {
-    error(ERR_IDENT_TOO_LONG, token->lineNo, token->colNo);
-    return token;
+  while (end - p >= 32) {
+    mask = ~(unsigned int) _mm256_movemask_epi8(blankMask256(_mm256_loadu_si256((const __m256i*) p)));
+    if (mask != 0) {
+      p += __builtin_ctz(mask);
+      break;
+    }
+    p += 32;
   }
+  // Not done by the compiler without -O: the SSE code after would stall
+  _mm256_zeroupper();
+  return p;
+}
+#endif
+
+// Returns the first non-blank byte at or after p (or end)
+const unsigned char* skipBlanks(const unsigned char *p, const unsigned char *end) {
+  const unsigned char *scalarEnd = ((end - p) > SCALAR_BLANKS) ? p + SCALAR_BLANKS : end;
+  unsigned int mask;
+  int wide;
+
+  // Tokens are mostly apart by a blank or two: vectors only pay off
+  // on longer runs such as indentation
+  while ((p < scalarEnd) && (charCodes[*p] == CHAR_SPACE))
+    p ++;
+  if ((p < scalarEnd) || (p == end))
+    return p;
+
+  if (simdBlanks) {
+#if defined(__SSE2__)
+    // A whole vector of blanks makes a run worth going over with AVX2
+    wide = __builtin_cpu_supports("avx2");
+    while (end - p >= 16) {
+      mask = ~(unsigned int) _mm_movemask_epi8(blankMask128(_mm_loadu_si128((const __m128i*) p))) & 0xFFFF;
+      if (mask != 0) return p + __builtin_ctz(mask);
+      p += 16;
+      if (wide) {
+        p = skipBlanks256(p, end);
+        wide = 0;
+      }
+    }
+#endif
+  }
+  while ((p < end) && (charCodes[*p] == CHAR_SPACE))
+    p ++;
+  return p;
+}
 
-  token->string[count] = '\0';
-  token->tokenType = checkKeyword(token->string);
+// Inside a comment only a '*' can change the state, so jump to the next
+// one (memchr is vectorised by the C library)
+const unsigned char* skipToStar(const unsigned char *p, const unsigned char *end) {
+  const unsigned char *star = memchr(p, '*', end - p);
+  return (star != NULL) ? star : end;
+}
 
-  if (token->tokenType == TK_NONE)
-    token->tokenType = TK_IDENT;
+static void scanLexeme(const char *text, size_t length, size_t pos, int state, Lexeme *lex) {
+  const unsigned char *base = (const unsigned char*) text;
+  const unsigned char *p = base + pos;
+  const unsigned char *end = base + length;
+  const unsigned char *start;
+  int next;
+
+  if (!transitionsReady)
+    buildTransitions();
+
+  if (state == ST_START)
+    p = skipBlanks(p, end);
+  start = p;
+  while (p < end) {
+    next = transitions[state][*p];
+    if (next <= ST_COMMENT) {
+      if (next == ST_DONE) break;
+      // Runs of blanks and comment text are skipped in bulk; a lexeme
+      // starts wherever the automaton leaves ST_START
+      state = next;
+      if (next == ST_START)
+        start = p = skipBlanks(p + 1, end);
+      else
+        p = skipToStar(p + 1, end);
+      continue;
+    }
+    state = next;
+    p ++;
+  }
 
-  return token;
+  lex->tokenType = stateInfo[state].tokenType;
+  lex->errorCode = stateInfo[state].errorCode;
+  lex->start = start - base;
+  lex->end = p - base;
+  // An unterminated comment is reported where the input runs out
+  lex->errorOffset = (state == ST_COMMENT || state == ST_COMMENT_STAR) ? lex->end : lex->start;
 }
 
-Token* readNumber(void) {
-  Token *token = makeToken(TK_NUMBER, lineNo, colNo);
-  int count = 0;
+void nextLexeme(const char *text, size_t length, size_t pos, Lexeme *lex) {
+  scanLexeme(text, length, pos, ST_START, lex);
+}
 
-  while ((currentChar != EOF) && (charCodes[currentChar] == CHAR_DIGIT)) {
-    token->string[count++] = (char)currentChar;
-    readChar();
-  }
+// As nextLexeme(), but as if pos were inside a comment: the lexeme is
+// the first one after the end of that comment
+void nextLexemeInComment(const char *text, size_t length, size_t pos, Lexeme *lex) {
+  scanLexeme(text, length, pos, ST_COMMENT, lex);
+}
 
-  token->string[count] = '\0';
-  token->value = atoi(token->string);
+// Tokens handed out by the scanner live in a ring owned by the scanner
+// and are recycled in place; see TOKEN_RING_SIZE. Each thread has its
+// own ring.
+static _Thread_local Token tokenRing[TOKEN_RING_SIZE];
+static _Thread_local unsigned int tokenRingNext = 0;
+
+Token* makeTokenAt(TokenType tokenType, size_t offset) {
+  Token *token = &tokenRing[tokenRingNext++ % TOKEN_RING_SIZE];
+  token->tokenType = tokenType;
+  token->offset = (unsigned int) offset;
+  locateOffset(offset, &token->lineNo, &token->colNo);
   return token;
 }
 
-Token* readConstChar(void) {
-  Token *token = makeToken(TK_CHAR, lineNo, colNo);
+void errorAt(int err, size_t offset) {
+  int ln, cn;
+  locateOffset(offset, &ln, &cn);
+  reportError(err, ln, cn);
+}
 
-  readChar();
-  if (currentChar == EOF) {
-    token->tokenType = TK_NONE;
-    error(ERR_INVALID_CONSTANT_CHAR, token->lineNo, token->colNo);
-    return token;
-  }
-    
-  token->string[0] = currentChar;
-  token->string[1] = '\0';
-
-  readChar();
-  if (currentChar == EOF) {
-    token->tokenType = TK_NONE;
-    error(ERR_INVALID_CONSTANT_CHAR, token->lineNo, token->colNo);
-    return token;
+// Completes a lexeme: tells keywords from identifiers, interning the
+// identifiers into atoms (the global table if NULL), and computes the
+// value of numbers and char constants
+void evaluateLexemeIn(const char *text, Lexeme *lex, AtomTable *atoms) {
+  char name[MAX_IDENT_LEN + 1];
+  size_t len = lex->end - lex->start;
+  size_t i;
+  TokenType keyword;
+  KplInt digit;
+
+  lex->value = 0;
+  switch (lex->tokenType) {
+  case TK_IDENT:
+    if (len > MAX_IDENT_LEN) {
+      lex->tokenType = TK_NONE;
+      lex->errorCode = ERR_IDENT_TOO_LONG;
+      lex->errorOffset = lex->start;
+      break;
+    }
+    for (i = 0; i < len; i++)
+      name[i] = toupper((unsigned char) text[lex->start + i]);
+    name[len] = '\0';
+    keyword = checkKeyword(name);
+    if (keyword != TK_NONE)
+      lex->tokenType = keyword;
+    else if (atoms != NULL)
+      lex->value = internAtomIn(atoms, name, len);
+    else
+      lex->value = internAtom(name, len);
+    break;
+  case TK_NUMBER:
+    // Accumulated as the digits come, stopping before the value would
+    // leave KplInt
+    for (i = 0; i < len; i++) {
+      digit = text[lex->start + i] - '0';
+      if (lex->value > (KPL_INT_MAX - digit) / 10) {
+        lex->tokenType = TK_NONE;
+        lex->errorCode = ERR_NUMBER_TOO_LARGE;
+        lex->errorOffset = lex->start;
+        lex->value = 0;
+        break;
+      }
+      lex->value = lex->value * 10 + digit;
+    }
+    break;
+  case TK_CHAR:
+    lex->value = (unsigned char) text[lex->start + 1];
+    break;
+  default:
+    break;
   }
+}
+
+void evaluateLexeme(const char *text, Lexeme *lex) {
+  evaluateLexemeIn(text, lex, NULL);
+}
 
-  if (charCodes[currentChar] == CHAR_SINGLEQUOTE) {
-    readChar();
-    return token;
-  } else {
-    token->tokenType = TK_NONE;
-    error(ERR_INVALID_CONSTANT_CHAR, token->lineNo, token->colNo);
-    return token;
+void setTokenValue(Token *token, KplInt value) {
+  token->value = value;
+  switch (token->tokenType) {
+  case TK_IDENT:
+    token->ident = atomName((int) value);
+    break;
+  case TK_CHAR:
+    token->string[0] = (char) value;
+    token->string[1] = '\0';
+    break;
+  default:
+    break;
   }
 }
 
 Token* getToken(void) {
+  Lexeme lex;
   Token *token;
-  int ln, cn;
 
-  if (currentChar == EOF) 
-    return makeToken(TK_EOF, lineNo, colNo);
-
-  switch (charCodes[currentChar]) {
-  case CHAR_SPACE: skipBlank(); return getToken();
-  case CHAR_LETTER: return readIdentKeyword();
-  case CHAR_DIGIT: return readNumber();
-  case CHAR_PLUS: 
-    token = makeToken(SB_PLUS, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_MINUS:
-    token = makeToken(SB_MINUS, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_TIMES:
-    token = makeToken(SB_TIMES, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_SLASH:
-    token = makeToken(SB_SLASH, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_LT:
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
-      readChar();
-      return makeToken(SB_LE, ln, cn);
-    } else return makeToken(SB_LT, ln, cn);
-  case CHAR_GT:
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
-      readChar();
-      return makeToken(SB_GE, ln, cn);
-    } else return makeToken(SB_GT, ln, cn);
-  case CHAR_EQ: 
-    token = makeToken(SB_EQ, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_EXCLAIMATION:
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
-      readChar();
-      return makeToken(SB_NEQ, ln, cn);
-    } else {
-      token = makeToken(TK_NONE, ln, cn);
-      error(ERR_INVALID_SYMBOL, ln, cn);
-      return token;
-    }
-  case CHAR_COMMA:
-    token = makeToken(SB_COMMA, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_PERIOD:
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_RPAR)) {
-      readChar();
-      return makeToken(SB_RSEL, ln, cn);
-    } else return makeToken(SB_PERIOD, ln, cn);
-  case CHAR_SEMICOLON:
-    token = makeToken(SB_SEMICOLON, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_COLON:
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
-      readChar();
-      return makeToken(SB_ASSIGN, ln, cn);
-    } else return makeToken(SB_COLON, ln, cn);
-  case CHAR_SINGLEQUOTE: return readConstChar();
-  case CHAR_LPAR:
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-
-    if (currentChar == EOF) 
-      return makeToken(SB_LPAR, ln, cn);
-
-    switch (charCodes[currentChar]) {
-    case CHAR_PERIOD:
-      readChar();
-      return makeToken(SB_LSEL, ln, cn);
-    case CHAR_TIMES:
-      readChar();
-      skipComment();
-      return getToken();
-    default:
-      return makeToken(SB_LPAR, ln, cn);
-    }
-  case CHAR_RPAR:
-    token = makeToken(SB_RPAR, lineNo, colNo);
-    readChar(); 
-    return token;
-  default:
-    token = makeToken(TK_NONE, lineNo, colNo);
-    error(ERR_INVALID_SYMBOL, lineNo, colNo);
-    readChar(); 
-    return token;
-  }
+  nextLexeme(inputBuffer, inputLength, inputPos, &lex);
+  evaluateLexeme(inputBuffer, &lex);
+  seekInput(lex.end);
+
+  token = makeTokenAt(lex.tokenType, lex.start);
+  setTokenValue(token, lex.value);
+  if (lex.errorCode != LEX_NO_ERROR)
+    errorAt(lex.errorCode, lex.errorOffset);
+  return token;
 }
 
 Token* getValidToken(void) {
   Token *token = getToken();
   while (token->tokenType == TK_NONE) {
-    free(token);
+    // Give the slot of the invalid token back so that skipping any number
+    // of them never overwrites the tokens the caller still holds
+    tokenRingNext --;
     token = getToken();
   }
   return token;
@@ -252,8 +442,8 @@ void printToken(Token *token) {
 
   switch (token->tokenType) {
   case TK_NONE: printf("TK_NONE\n"); break;
-  case TK_IDENT: printf("TK_IDENT(%s)\n", token->string); break;
-  case TK_NUMBER: printf("TK_NUMBER(%s)\n", token->string); break;
+  case TK_IDENT: printf("TK_IDENT(%s)\n", token->ident); break;
+  case TK_NUMBER: printf("TK_NUMBER(" KPL_INT_FORMAT ")\n", token->value); break;
   case TK_CHAR: printf("TK_CHAR(\'%s\')\n", token->string); break;
   case TK_EOF: printf("TK_EOF\n"); break;
 
@@ -7,8 +7,38 @@
 #ifndef __SCANNER_H__
 #define __SCANNER_H__
 
+#include <stddef.h>
 #include "token.h"
+#include "atom.h"
 
+#define LEX_NO_ERROR (-1)
+
+// getToken() and getValidToken() return tokens from a ring that the
+// scanner reuses: a token must not be freed, and stays valid until
+// TOKEN_RING_SIZE more tokens have been returned.
+#define TOKEN_RING_SIZE 8
+
+// One lexeme recognised in a source text: its token type and extent,
+// with the error (an ErrorCode) to report at errorOffset if any.
+// value is filled in by evaluateLexeme(), as for Token.value; it is the
+// character code for TK_CHAR.
+typedef struct {
+  TokenType tokenType;
+  size_t start;
+  size_t end;
+  int errorCode;
+  size_t errorOffset;
+  KplInt value;
+} Lexeme;
+
+void buildTransitions(void);
+void nextLexeme(const char *text, size_t length, size_t pos, Lexeme *lex);
+void nextLexemeInComment(const char *text, size_t length, size_t pos, Lexeme *lex);
+void evaluateLexeme(const char *text, Lexeme *lex);
+void evaluateLexemeIn(const char *text, Lexeme *lex, AtomTable *atoms);
+Token* makeTokenAt(TokenType tokenType, size_t offset);
+void setTokenValue(Token *token, KplInt value);
+void errorAt(int err, size_t offset);
 Token* getToken(void);
 Token* getValidToken(void);
 void printToken(Token *token);
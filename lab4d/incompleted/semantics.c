@@ -9,25 +9,59 @@
 #include "semantics.h"
 #include "error.h"
 
-extern SymTab* symtab;
-extern Token* currentToken;
+extern _Thread_local SymTab* symtab;
+extern _Thread_local Token* currentToken;
+
+// A routine body parsed in parallel sees its enclosing scope as it was
+// when the body began: only the first snapshotCount objects of
+// snapshotScope, the ones declared later being hidden
+static _Thread_local Scope* snapshotScope = NULL;
+static _Thread_local int snapshotCount = 0;
+
+// Set while a routine is checked for an edit session: the outer objects
+// it finds are recorded there, the routine itself aside
+static _Thread_local DependencyList* dependencies = NULL;
+
+void setScopeSnapshot(Scope* scope, int count) {
+  snapshotScope = scope;
+  snapshotCount = count;
+}
+
+void recordDependencies(DependencyList *list) {
+  dependencies = list;
+}
+
+static void addDependency(Object* obj) {
+  if ((dependencies == NULL) || (obj == dependencies->routine)) return;
+  if (dependencies->count == dependencies->capacity) {
+    dependencies->capacity = (dependencies->capacity == 0) ? 16 : dependencies->capacity * 2;
+    dependencies->items = (Dependency*) realloc(dependencies->items,
+                                                dependencies->capacity * sizeof(Dependency));
+  }
+  dependencies->items[dependencies->count].name = obj->name;
+  dependencies->items[dependencies->count].signature = objectSignature(obj);
+  dependencies->count ++;
+}
 
 Object* lookupObject(char *name) {
   Scope* scope = symtab->currentScope;
   Object* obj;
 
   while (scope != NULL) {
-    obj = findObject(scope->objList, name);
-    if (obj != NULL) return obj;
+    obj = findScopeObject(scope, name);
+    if ((obj != NULL) && ((scope != snapshotScope) || (obj->order < snapshotCount))) {
+      if (scope == snapshotScope) addDependency(obj);
+      return obj;
+    }
     scope = scope->outer;
   }
   obj = findObject(symtab->globalObjectList, name);
-  if (obj != NULL) return obj;
-  return NULL;
+  if (obj != NULL) addDependency(obj);
+  return obj;
 }
 
 void checkFreshIdent(char *name) {
-  if (findObject(symtab->currentScope->objList, name) != NULL)
+  if (findScopeObject(symtab->currentScope, name) != NULL)
     error(ERR_DUPLICATE_IDENT, currentToken->lineNo, currentToken->colNo);
 }
 
@@ -134,20 +168,9 @@ void checkArrayType(Type* type) {
   }
 }
 
+// Types are hash-consed (see symtab.c), so equal types are the same object
 void checkTypeEquality(Type* type1, Type* type2) {
-  if (type1 == NULL || type2 == NULL) {
-    error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
-  }
-  if (type1->typeClass != type2->typeClass) {
+  if (type1 == NULL || type2 == NULL || type1 != type2) {
     error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
   }
-  if (type1->typeClass == TP_ARRAY) {
-    if (type1->arraySize != type2->arraySize) {
-      error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
-    }
-    checkTypeEquality(type1->elementType, type2->elementType);
-  }
-  // For TP_INT and TP_CHAR, nothing more to check
 }
-
-
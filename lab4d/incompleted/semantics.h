@@ -9,6 +9,24 @@
 
 #include "symtab.h"
 
+void setScopeSnapshot(Scope* scope, int count);
+
+// An object of the snapshot scope or a builtin that the routine being
+// checked looked up, and its signature (see objectSignature())
+typedef struct {
+  char *name;
+  unsigned long long signature;
+} Dependency;
+
+typedef struct {
+  Object *routine;
+  Dependency *items;
+  int count;
+  int capacity;
+} DependencyList;
+
+void recordDependencies(DependencyList *list);
+
 void checkFreshIdent(char *name);
 Object* checkDeclaredIdent(char *name);
 Object* checkDeclaredConstant(char *name);
@@ -6,92 +6,175 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <pthread.h>
 #include "symtab.h"
+#include "atom.h"
+#include "arena.h"
 #include "error.h"
 
-void freeObject(Object* obj);
-void freeScope(Scope* scope);
-void freeObjectList(ObjectNode *objList);
-void freeReferenceList(ObjectNode *objList);
-
-SymTab* symtab;
+// Each parsing thread works on a SymTab of its own (see parser.c), so
+// that it has its own current scope
+_Thread_local SymTab* symtab;
 Type* intType;
 Type* charType;
 
+// Everything in the symbol table (objects, their attributes, scopes,
+// list nodes, types and constants) is allocated from symtabArena, so
+// the table is released in one go by cleanSymTab(). Threads that parse
+// routine bodies in parallel allocate from threadArenas instead, one
+// slot each (see useThreadArena()).
+static Arena symtabArena = ARENA_INIT;
+static Arena threadArenas[MAX_SYMTAB_THREADS];
+static _Thread_local Arena *currentArena = &symtabArena;
+
+#define SYMTAB_NEW(T) ((T*) arenaAlloc(currentArena, sizeof(T)))
+
+void useThreadArena(int slot) {
+  currentArena = &threadArenas[slot];
+}
+
+size_t symtabBytesUsed(void) {
+  size_t bytes = symtabArena.bytesUsed;
+  int i;
+  for (i = 0; i < MAX_SYMTAB_THREADS; i++)
+    bytes += threadArenas[i].bytesUsed;
+  return bytes;
+}
+
+size_t symtabBytesReserved(void) {
+  size_t bytes = symtabArena.bytesReserved;
+  int i;
+  for (i = 0; i < MAX_SYMTAB_THREADS; i++)
+    bytes += threadArenas[i].bytesReserved;
+  return bytes;
+}
+
 /******************* Type utilities ******************************/
 
-Type* makeIntType(void) {
-  Type* type = (Type*) malloc(sizeof(Type));
-  type->typeClass = TP_INT;
+// Types are hash-consed: there is one shared, immutable Type for each
+// structure. Int and Char are the singletons intType and charType, and
+// array types are kept in arrayTypes, keyed by size and element type.
+// Structurally equal types are therefore the same pointer. arrayTypes
+// is shared by all the parsing threads, under arrayTypesLock.
+
+#define ARRAY_TYPES_MIN_SIZE 64
+
+static Type **arrayTypes = NULL;
+static int arrayTypesSize = 0;
+static int arrayTypesCount = 0;
+static pthread_mutex_t arrayTypesLock = PTHREAD_MUTEX_INITIALIZER;
+
+Type* newType(enum TypeClass typeClass) {
+  Type* type = SYMTAB_NEW(Type);
+  type->typeClass = typeClass;
+  type->arraySize = 0;
+  type->elementType = NULL;
   return type;
 }
 
+unsigned int hashArrayType(int arraySize, Type* elementType) {
+  return (unsigned int) ((((uintptr_t) elementType >> 3) ^ (unsigned int) arraySize) * 2654435761u);
+}
+
+void insertArrayType(Type* type) {
+  unsigned int mask = arrayTypesSize - 1;
+  unsigned int h = hashArrayType(type->arraySize, type->elementType) & mask;
+
+  while (arrayTypes[h] != NULL)
+    h = (h + 1) & mask;
+  arrayTypes[h] = type;
+}
+
+void growArrayTypes(void) {
+  Type **old = arrayTypes;
+  int oldSize = arrayTypesSize;
+  int i;
+
+  arrayTypesSize = (oldSize == 0) ? ARRAY_TYPES_MIN_SIZE : oldSize * 2;
+  arrayTypes = (Type**) arenaCalloc(currentArena, arrayTypesSize, sizeof(Type*));
+  for (i = 0; i < oldSize; i++)
+    if (old[i] != NULL)
+      insertArrayType(old[i]);
+}
+
+void initTypes(void) {
+  intType = newType(TP_INT);
+  charType = newType(TP_CHAR);
+}
+
+void resetTypes(void) {
+  arrayTypes = NULL;
+  arrayTypesSize = arrayTypesCount = 0;
+  intType = charType = NULL;
+}
+
+Type* makeIntType(void) {
+  return intType;
+}
+
 Type* makeCharType(void) {
-  Type* type = (Type*) malloc(sizeof(Type));
-  type->typeClass = TP_CHAR;
-  return type;
+  return charType;
 }
 
 Type* makeArrayType(int arraySize, Type* elementType) {
-  Type* type = (Type*) malloc(sizeof(Type));
-  type->typeClass = TP_ARRAY;
+  Type* type;
+  unsigned int mask, h;
+
+  pthread_mutex_lock(&arrayTypesLock);
+  if (arrayTypesSize > 0) {
+    mask = arrayTypesSize - 1;
+    h = hashArrayType(arraySize, elementType) & mask;
+    while ((type = arrayTypes[h]) != NULL) {
+      if ((type->arraySize == arraySize) && (type->elementType == elementType)) {
+        pthread_mutex_unlock(&arrayTypesLock);
+        return type;
+      }
+      h = (h + 1) & mask;
+    }
+  }
+
+  type = newType(TP_ARRAY);
   type->arraySize = arraySize;
   type->elementType = elementType;
+
+  // Keep the table at most half full
+  if (2 * (arrayTypesCount + 1) > arrayTypesSize)
+    growArrayTypes();
+  insertArrayType(type);
+  arrayTypesCount ++;
+  pthread_mutex_unlock(&arrayTypesLock);
   return type;
 }
 
+// Types are shared and immutable, so a copy is the type itself
 Type* duplicateType(Type* type) {
-  Type* resultType = (Type*) malloc(sizeof(Type));
-  resultType->typeClass = type->typeClass;
-  if (type->typeClass == TP_ARRAY) {
-    resultType->arraySize = type->arraySize;
-    resultType->elementType = duplicateType(type->elementType);
-  }
-  return resultType;
+  return type;
 }
 
 int compareType(Type* type1, Type* type2) {
-  if (type1->typeClass == type2->typeClass) {
-    if (type1->typeClass == TP_ARRAY) {
-      if (type1->arraySize == type2->arraySize)
-	return compareType(type1->elementType, type2->elementType);
-      else return 0;
-    } else return 1;
-  } else return 0;
-}
-
-void freeType(Type* type) {
-  switch (type->typeClass) {
-  case TP_INT:
-  case TP_CHAR:
-    free(type);
-    break;
-  case TP_ARRAY:
-    freeType(type->elementType);
-    freeType(type);
-    break;
-  }
+  return type1 == type2;
 }
 
 /******************* Constant utility ******************************/
 
-ConstantValue* makeIntConstant(int i) {
-  ConstantValue* value = (ConstantValue*) malloc(sizeof(ConstantValue));
+ConstantValue* makeIntConstant(KplInt i) {
+  ConstantValue* value = SYMTAB_NEW(ConstantValue);
   value->type = TP_INT;
   value->intValue = i;
   return value;
 }
 
 ConstantValue* makeCharConstant(char ch) {
-  ConstantValue* value = (ConstantValue*) malloc(sizeof(ConstantValue));
+  ConstantValue* value = SYMTAB_NEW(ConstantValue);
   value->type = TP_CHAR;
   value->charValue = ch;
   return value;
 }
 
 ConstantValue* duplicateConstantValue(ConstantValue* v) {
-  ConstantValue* value = (ConstantValue*) malloc(sizeof(ConstantValue));
+  ConstantValue* value = SYMTAB_NEW(ConstantValue);
   value->type = v->type;
   if (v->type == TP_INT) 
     value->intValue = v->intValue;
@@ -103,18 +186,22 @@ ConstantValue* duplicateConstantValue(ConstantValue* v) {
 /******************* Object utilities ******************************/
 
 Scope* createScope(Object* owner, Scope* outer) {
-  Scope* scope = (Scope*) malloc(sizeof(Scope));
+  Scope* scope = SYMTAB_NEW(Scope);
   scope->objList = NULL;
+  scope->objTail = NULL;
+  scope->index = NULL;
+  scope->indexSize = 0;
+  scope->objCount = 0;
   scope->owner = owner;
   scope->outer = outer;
   return scope;
 }
 
 Object* createProgramObject(char *programName) {
-  Object* program = (Object*) malloc(sizeof(Object));
-  strcpy(program->name, programName);
+  Object* program = SYMTAB_NEW(Object);
+  program->name = programName;
   program->kind = OBJ_PROGRAM;
-  program->progAttrs = (ProgramAttributes*) malloc(sizeof(ProgramAttributes));
+  program->progAttrs = SYMTAB_NEW(ProgramAttributes);
   program->progAttrs->scope = createScope(program,NULL);
   symtab->program = program;
 
@@ -122,124 +209,64 @@ Object* createProgramObject(char *programName) {
 }
 
 Object* createConstantObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  Object* obj = SYMTAB_NEW(Object);
+  obj->name = name;
   obj->kind = OBJ_CONSTANT;
-  obj->constAttrs = (ConstantAttributes*) malloc(sizeof(ConstantAttributes));
+  obj->constAttrs = SYMTAB_NEW(ConstantAttributes);
   return obj;
 }
 
 Object* createTypeObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  Object* obj = SYMTAB_NEW(Object);
+  obj->name = name;
   obj->kind = OBJ_TYPE;
-  obj->typeAttrs = (TypeAttributes*) malloc(sizeof(TypeAttributes));
+  obj->typeAttrs = SYMTAB_NEW(TypeAttributes);
   return obj;
 }
 
 Object* createVariableObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  Object* obj = SYMTAB_NEW(Object);
+  obj->name = name;
   obj->kind = OBJ_VARIABLE;
-  obj->varAttrs = (VariableAttributes*) malloc(sizeof(VariableAttributes));
+  obj->varAttrs = SYMTAB_NEW(VariableAttributes);
   obj->varAttrs->scope = symtab->currentScope;
   return obj;
 }
 
 Object* createFunctionObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  Object* obj = SYMTAB_NEW(Object);
+  obj->name = name;
   obj->kind = OBJ_FUNCTION;
-  obj->funcAttrs = (FunctionAttributes*) malloc(sizeof(FunctionAttributes));
+  obj->funcAttrs = SYMTAB_NEW(FunctionAttributes);
   obj->funcAttrs->paramList = NULL;
+  // Left so by a header the parser gives up on
+  obj->funcAttrs->returnType = NULL;
   obj->funcAttrs->scope = createScope(obj, symtab->currentScope);
   return obj;
 }
 
 Object* createProcedureObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  Object* obj = SYMTAB_NEW(Object);
+  obj->name = name;
   obj->kind = OBJ_PROCEDURE;
-  obj->procAttrs = (ProcedureAttributes*) malloc(sizeof(ProcedureAttributes));
+  obj->procAttrs = SYMTAB_NEW(ProcedureAttributes);
   obj->procAttrs->paramList = NULL;
   obj->procAttrs->scope = createScope(obj, symtab->currentScope);
   return obj;
 }
 
 Object* createParameterObject(char *name, enum ParamKind kind, Object* owner) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  Object* obj = SYMTAB_NEW(Object);
+  obj->name = name;
   obj->kind = OBJ_PARAMETER;
-  obj->paramAttrs = (ParameterAttributes*) malloc(sizeof(ParameterAttributes));
+  obj->paramAttrs = SYMTAB_NEW(ParameterAttributes);
   obj->paramAttrs->kind = kind;
   obj->paramAttrs->function = owner;
   return obj;
 }
 
-void freeObject(Object* obj) {
-  switch (obj->kind) {
-  case OBJ_CONSTANT:
-    free(obj->constAttrs->value);
-    free(obj->constAttrs);
-    break;
-  case OBJ_TYPE:
-    free(obj->typeAttrs->actualType);
-    free(obj->typeAttrs);
-    break;
-  case OBJ_VARIABLE:
-    free(obj->varAttrs->type);
-    free(obj->varAttrs);
-    break;
-  case OBJ_FUNCTION:
-    freeReferenceList(obj->funcAttrs->paramList);
-    freeType(obj->funcAttrs->returnType);
-    freeScope(obj->funcAttrs->scope);
-    free(obj->funcAttrs);
-    break;
-  case OBJ_PROCEDURE:
-    freeReferenceList(obj->procAttrs->paramList);
-    freeScope(obj->procAttrs->scope);
-    free(obj->procAttrs);
-    break;
-  case OBJ_PROGRAM:
-    freeScope(obj->progAttrs->scope);
-    free(obj->progAttrs);
-    break;
-  case OBJ_PARAMETER:
-    freeType(obj->paramAttrs->type);
-    free(obj->paramAttrs);
-  }
-  free(obj);
-}
-
-void freeScope(Scope* scope) {
-  freeObjectList(scope->objList);
-  free(scope);
-}
-
-void freeObjectList(ObjectNode *objList) {
-  ObjectNode* list = objList;
-
-  while (list != NULL) {
-    ObjectNode* node = list;
-    list = list->next;
-    freeObject(node->object);
-    free(node);
-  }
-}
-
-void freeReferenceList(ObjectNode *objList) {
-  ObjectNode* list = objList;
-
-  while (list != NULL) {
-    ObjectNode* node = list;
-    list = list->next;
-    free(node);
-  }
-}
-
 void addObject(ObjectNode **objList, Object* obj) {
-  ObjectNode* node = (ObjectNode*) malloc(sizeof(ObjectNode));
+  ObjectNode* node = SYMTAB_NEW(ObjectNode);
   node->object = obj;
   node->next = NULL;
   if ((*objList) == NULL) 
@@ -254,55 +281,166 @@ void addObject(ObjectNode **objList, Object* obj) {
 
 Object* findObject(ObjectNode *objList, char *name) {
   while (objList != NULL) {
-    if (strcmp(objList->object->name, name) == 0) 
+    if (objList->object->name == name) 
       return objList->object;
     else objList = objList->next;
   }
   return NULL;
 }
 
+#define SCOPE_INDEX_MIN_SIZE 16
+
+unsigned int hashObjectName(char *name) {
+  return (unsigned int) (((uintptr_t) name >> 3) * 2654435761u);
+}
+
+// Adds obj to the index unless an object of the same name is already
+// there: like a walk of objList, lookups find the first declaration
+void indexScopeObject(Scope *scope, Object *obj) {
+  unsigned int mask = scope->indexSize - 1;
+  unsigned int h = hashObjectName(obj->name) & mask;
+
+  while (scope->index[h] != NULL) {
+    if (scope->index[h]->name == obj->name) return;
+    h = (h + 1) & mask;
+  }
+  scope->index[h] = obj;
+}
+
+void growScopeIndex(Scope *scope) {
+  ObjectNode *node;
+
+  scope->indexSize = (scope->indexSize == 0) ? SCOPE_INDEX_MIN_SIZE : scope->indexSize * 2;
+  scope->index = (Object**) arenaCalloc(currentArena, scope->indexSize, sizeof(Object*));
+  for (node = scope->objList; node != NULL; node = node->next)
+    indexScopeObject(scope, node->object);
+}
+
+void addScopeObject(Scope *scope, Object *obj) {
+  ObjectNode* node = SYMTAB_NEW(ObjectNode);
+  node->object = obj;
+  node->next = NULL;
+  if (scope->objTail == NULL)
+    scope->objList = node;
+  else
+    scope->objTail->next = node;
+  scope->objTail = node;
+  obj->order = scope->objCount ++;
+
+  // Keep the index at most half full
+  if (2 * scope->objCount > scope->indexSize)
+    growScopeIndex(scope);
+  else
+    indexScopeObject(scope, obj);
+}
+
+Object* findScopeObject(Scope *scope, char *name) {
+  unsigned int mask, h;
+
+  if (scope->index == NULL) return NULL;
+  mask = scope->indexSize - 1;
+  h = hashObjectName(name) & mask;
+  while (scope->index[h] != NULL) {
+    if (scope->index[h]->name == name)
+      return scope->index[h];
+    h = (h + 1) & mask;
+  }
+  return NULL;
+}
+
+// What a routine that looks obj up can tell about it, hashed: objects
+// with the same signature check alike. Types are hash-consed, so they
+// are hashed by address.
+unsigned long long objectSignature(Object *obj) {
+  unsigned long long h = 14695981039346656037ull;
+  ObjectNode *node = NULL;
+  ConstantValue *value;
+
+#define MIX(x) (h = (h ^ (unsigned long long) (x)) * 1099511628211ull)
+  MIX(obj->kind);
+  switch (obj->kind) {
+  case OBJ_CONSTANT:
+    value = obj->constAttrs->value;
+    if (value != NULL) {
+      MIX(value->type);
+      MIX((value->type == TP_CHAR) ? value->charValue : value->intValue);
+    }
+    break;
+  case OBJ_TYPE:
+    MIX((uintptr_t) obj->typeAttrs->actualType);
+    break;
+  case OBJ_VARIABLE:
+    MIX((uintptr_t) obj->varAttrs->type);
+    break;
+  case OBJ_FUNCTION:
+    MIX((uintptr_t) obj->funcAttrs->returnType);
+    node = obj->funcAttrs->paramList;
+    break;
+  case OBJ_PROCEDURE:
+    node = obj->procAttrs->paramList;
+    break;
+  case OBJ_PARAMETER:
+    MIX(obj->paramAttrs->kind);
+    MIX((uintptr_t) obj->paramAttrs->type);
+    break;
+  default:
+    break;
+  }
+  for (; node != NULL; node = node->next) {
+    MIX(node->object->paramAttrs->kind);
+    MIX((uintptr_t) node->object->paramAttrs->type);
+  }
+#undef MIX
+  return h;
+}
+
 /******************* others ******************************/
 
+char *internName(char *name) {
+  return atomName(internAtom(name, strlen(name)));
+}
+
 void initSymTab(void) {
   Object* obj;
   Object* param;
 
-  symtab = (SymTab*) malloc(sizeof(SymTab));
+  symtab = SYMTAB_NEW(SymTab);
   symtab->globalObjectList = NULL;
+
+  initTypes();
   
-  obj = createFunctionObject("READC");
+  obj = createFunctionObject(internName("READC"));
   obj->funcAttrs->returnType = makeCharType();
   addObject(&(symtab->globalObjectList), obj);
 
-  obj = createFunctionObject("READI");
+  obj = createFunctionObject(internName("READI"));
   obj->funcAttrs->returnType = makeIntType();
   addObject(&(symtab->globalObjectList), obj);
 
-  obj = createProcedureObject("WRITEI");
-  param = createParameterObject("i", PARAM_VALUE, obj);
+  obj = createProcedureObject(internName("WRITEI"));
+  param = createParameterObject(internName("i"), PARAM_VALUE, obj);
   param->paramAttrs->type = makeIntType();
   addObject(&(obj->procAttrs->paramList),param);
   addObject(&(symtab->globalObjectList), obj);
 
-  obj = createProcedureObject("WRITEC");
-  param = createParameterObject("ch", PARAM_VALUE, obj);
+  obj = createProcedureObject(internName("WRITEC"));
+  param = createParameterObject(internName("ch"), PARAM_VALUE, obj);
   param->paramAttrs->type = makeCharType();
   addObject(&(obj->procAttrs->paramList),param);
   addObject(&(symtab->globalObjectList), obj);
 
-  obj = createProcedureObject("WRITELN");
+  obj = createProcedureObject(internName("WRITELN"));
   addObject(&(symtab->globalObjectList), obj);
-
-  intType = makeIntType();
-  charType = makeCharType();
 }
 
 void cleanSymTab(void) {
-  freeObject(symtab->program);
-  freeObjectList(symtab->globalObjectList);
-  free(symtab);
-  freeType(intType);
-  freeType(charType);
+  int i;
+
+  freeArena(&symtabArena);
+  for (i = 0; i < MAX_SYMTAB_THREADS; i++)
+    freeArena(&threadArenas[i]);
+  symtab = NULL;
+  resetTypes();
 }
 
 void enterBlock(Scope* scope) {
@@ -328,7 +466,7 @@ void declareObject(Object* obj) {
     }
   }
  
-  addObject(&(symtab->currentScope->objList), obj);
+  addScopeObject(symtab->currentScope, obj);
 }
 
 
@@ -7,8 +7,12 @@
 #ifndef __SYMTAB_H__
 #define __SYMTAB_H__
 
+#include <stddef.h>
 #include "token.h"
 
+// Threads besides the main one that may allocate symbols at once
+#define MAX_SYMTAB_THREADS 63
+
 enum TypeClass {
   TP_INT,
   TP_CHAR,
@@ -43,7 +47,7 @@ typedef struct Type_ BasicType;
 struct ConstantValue_ {
   enum TypeClass type;
   union {
-    int intValue;
+    KplInt intValue;
     char charValue;
   };
 };
@@ -96,9 +100,12 @@ typedef struct ProcedureAttributes_ ProcedureAttributes;
 typedef struct ProgramAttributes_ ProgramAttributes;
 typedef struct ParameterAttributes_ ParameterAttributes;
 
+// name is an interned atom (see atom.h): names are compared by pointer.
+// order is the position of the object in its scope's declaration list.
 struct Object_ {
-  char name[MAX_IDENT_LEN];
+  char *name;
   enum ObjectKind kind;
+  int order;
   union {
     ConstantAttributes* constAttrs;
     VariableAttributes* varAttrs;
@@ -119,8 +126,14 @@ struct ObjectNode_ {
 
 typedef struct ObjectNode_ ObjectNode;
 
+// objList keeps the declaration order; index is an open-addressing hash
+// of the same objects by name pointer, with indexSize slots (a power of 2)
 struct Scope_ {
   ObjectNode *objList;
+  ObjectNode *objTail;
+  Object **index;
+  int indexSize;
+  int objCount;
   Object *owner;
   struct Scope_ *outer;
 };
@@ -140,9 +153,8 @@ Type* makeCharType(void);
 Type* makeArrayType(int arraySize, Type* elementType);
 Type* duplicateType(Type* type);
 int compareType(Type* type1, Type* type2);
-void freeType(Type* type);
 
-ConstantValue* makeIntConstant(int i);
+ConstantValue* makeIntConstant(KplInt i);
 ConstantValue* makeCharConstant(char ch);
 ConstantValue* duplicateConstantValue(ConstantValue* v);
 
@@ -157,9 +169,15 @@ Object* createProcedureObject(char *name);
 Object* createParameterObject(char *name, enum ParamKind kind, Object* owner);
 
 Object* findObject(ObjectNode *objList, char *name);
+Object* findScopeObject(Scope *scope, char *name);
+unsigned long long objectSignature(Object *obj);
+char *internName(char *name);
 
 void initSymTab(void);
 void cleanSymTab(void);
+void useThreadArena(int slot);
+size_t symtabBytesUsed(void);
+size_t symtabBytesReserved(void);
 void enterBlock(Scope* scope);
 void exitBlock(void);
 void declareObject(Object* obj);
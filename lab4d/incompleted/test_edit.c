@@ -0,0 +1,94 @@
+/* Edit session test
+ * Opens an edit session on a program of four routines, then edits it
+ * and checks after each change how many routines were declared again
+ * as they were and how many were parsed, and the errors found.
+ *
+ * usage: test_edit
+ * Prints one line per step and exits with 1 if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parser.h"
+#include "error.h"
+
+extern int maxErrors;
+extern _Thread_local SymTab* symtab;
+
+const char *program =
+  "Program Edits;\n"
+  "Const n = 10;\n"
+  "Type vector = Array(. 10 .) of Integer;\n"
+  "Var a : vector;\n"
+  "    i : Integer;\n"
+  "Procedure fill(k : Integer);\n"
+  "  Var j : Integer;\n"
+  "  Begin For j := 1 To n Do a(.j.) := k End;\n"
+  "Function sum : Integer;\n"
+  "  Var j : Integer; s : Integer;\n"
+  "  Begin s := 0; For j := 1 To n Do s := s + a(.j.); sum := s End;\n"
+  "Procedure show;\n"
+  "  Begin Call WriteI(i) End;\n"
+  "Function twice(x : Integer) : Integer;\n"
+  "  Begin twice := x + x End;\n"
+  "Begin\n"
+  "  Call fill(1); i := twice(sum); Call show\n"
+  "End.\n";
+
+// The session reads the text in place, so the last one is kept
+char *text = NULL;
+size_t textLength = 0;
+int failures = 0;
+
+void check(const char *step, EditStats stats, int reused, int parsed, int errors) {
+  int ok = (stats.reused == reused) && (stats.parsed == parsed) && (errorCount() == errors) &&
+           ((errors > 0) || (symtab->program != NULL));
+
+  printf("%-28s reused %d parsed %d errors %d  %s\n", step,
+         stats.reused, stats.parsed, errorCount(), ok ? "ok" : "FAILED");
+  if (!ok) {
+    printf("  expected reused %d parsed %d errors %d\n", reused, parsed, errors);
+    failures ++;
+  }
+}
+
+// Replaces the first from of the text by to
+EditStats edit(const char *from, const char *to) {
+  char *old = text;
+  size_t offset = strstr(old, from) - old;
+  size_t deleted = strlen(from);
+  size_t inserted = strlen(to);
+  EditStats stats;
+
+  textLength = textLength - deleted + inserted;
+  text = (char*) malloc(textLength + 1);
+  memcpy(text, old, offset);
+  memcpy(text + offset, to, inserted);
+  strcpy(text + offset + inserted, old + offset + deleted);
+
+  stats = updateEditSession(text, textLength, offset, deleted, inserted);
+  free(old);
+  return stats;
+}
+
+int main(void) {
+  maxErrors = 0;
+  textLength = strlen(program);
+  text = strdup(program);
+
+  check("open", openEditSession(text, textLength), 0, 4, 0);
+  check("no change", edit("twice := x + x", "twice := x + x"), 4, 0, 0);
+  check("body of twice", edit("twice := x + x", "twice := 2 * x"), 3, 1, 0);
+  check("constant n", edit("n = 10", "n = 5"), 2, 2, 0);
+  check("type vector", edit("(. 10 .)", "(. 20 .)"), 2, 2, 0);
+  check("variable i removed", edit("    i : Integer;\n", ""), 3, 1, 2);
+  check("variable i back", edit("Var a : vector;\n", "Var a : vector;\n    i : Integer;\n"), 3, 1, 0);
+  check("procedure fill removed",
+        edit("Procedure fill(k : Integer);\n  Var j : Integer;\n"
+             "  Begin For j := 1 To n Do a(.j.) := k End;\n", ""), 3, 0, 1);
+
+  closeEditSession();
+  free(text);
+  return (failures > 0) ? 1 : 0;
+}
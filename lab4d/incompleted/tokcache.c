@@ -0,0 +1,167 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tokcache.h"
+#include "atom.h"
+
+// 64-bit FNV-1a of the source text
+unsigned long long hashSource(const char *text, size_t length) {
+  unsigned long long h = 14695981039346656037ULL;
+  size_t i;
+  for (i = 0; i < length; i++) {
+    h ^= (unsigned char) text[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+// Everything the parser will trust without looking again: the layout,
+// the token types, and that every identifier names a stored atom
+static int checkCache(const char *map, size_t size, const char *text, size_t length) {
+  const TokenCacheHeader *header = (const TokenCacheHeader*) map;
+  const unsigned char *types;
+  const KplInt *values;
+  const char *names;
+  const char *end;
+  unsigned int i, n;
+
+  if (size < sizeof(TokenCacheHeader)) return 0;
+  if ((header->magic != TOKEN_CACHE_MAGIC) || (header->version != TOKEN_CACHE_VERSION) ||
+      (header->valueSize != sizeof(KplInt)))
+    return 0;
+  if (header->sourceLength != length) return 0;
+
+  n = header->tokenCount;
+  if ((n == 0) || (size != sizeof(TokenCacheHeader) + (size_t) n * (sizeof(KplInt) + 5) + header->namesSize))
+    return 0;
+  if (header->sourceHash != hashSource(text, length)) return 0;
+
+  values = (const KplInt*) (map + sizeof(TokenCacheHeader));
+  types = (const unsigned char*) (map + sizeof(TokenCacheHeader) + (size_t) n * (sizeof(KplInt) + 4));
+  names = (const char*) (types + n);
+
+  end = names + header->namesSize;
+  for (i = 0; i < header->atomCount; i++) {
+    names = memchr(names, '\0', end - names);
+    if (names == NULL) return 0;
+    names ++;
+  }
+  if (types[n - 1] != TK_EOF) return 0;
+  for (i = 0; i < n; i++) {
+    if (types[i] > SB_RSEL) return 0;
+    if ((types[i] == TK_IDENT) && ((values[i] < 0) || (values[i] >= header->atomCount)))
+      return 0;
+  }
+  return 1;
+}
+
+// The arrays of stream are left pointing into the mapped file, which
+// freeTokenStream() unmaps
+int loadTokenCache(const char *path, const char *text, size_t length, TokenStream *stream) {
+  const TokenCacheHeader *header;
+  struct stat st;
+  const char *map;
+  const char *names;
+  unsigned int i, n;
+  size_t len;
+  int fd;
+
+  if (atomCount() != 0) return 0;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) return 0;
+  if ((fstat(fd, &st) != 0) || (st.st_size < (off_t) sizeof(TokenCacheHeader))) {
+    close(fd);
+    return 0;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return 0;
+
+  if (!checkCache(map, st.st_size, text, length)) {
+    munmap((void*) map, st.st_size);
+    return 0;
+  }
+
+  header = (const TokenCacheHeader*) map;
+  n = header->tokenCount;
+  stream->values = (KplInt*) (map + sizeof(TokenCacheHeader));
+  stream->offsets = (unsigned int*) (stream->values + n);
+  stream->types = (unsigned char*) (stream->offsets + n);
+  stream->count = stream->capacity = n;
+  stream->mapping = (void*) map;
+  stream->mappingSize = st.st_size;
+
+  // Interned in id order, the names get back the ids they were stored with
+  names = (const char*) (stream->types + n);
+  for (i = 0; i < header->atomCount; i++) {
+    len = strlen(names);
+    internAtom(names, len);
+    names += len + 1;
+  }
+  return 1;
+}
+
+// Written to a temporary file of its own and renamed, so that a
+// concurrent run never maps a half-written cache, nor writes into this
+// one's
+int saveTokenCache(const char *path, const char *text, size_t length, TokenStream *stream) {
+  TokenCacheHeader header;
+  char *tmpPath;
+  mode_t mask;
+  FILE *f;
+  int fd, i, ok;
+
+  header.magic = TOKEN_CACHE_MAGIC;
+  header.version = TOKEN_CACHE_VERSION;
+  header.sourceHash = hashSource(text, length);
+  header.sourceLength = length;
+  header.tokenCount = stream->count;
+  header.atomCount = atomCount();
+  header.valueSize = sizeof(KplInt);
+  header.namesSize = 0;
+  for (i = 0; i < atomCount(); i++)
+    header.namesSize += strlen(atomName(i)) + 1;
+
+  tmpPath = (char*) malloc(strlen(path) + 8);
+  sprintf(tmpPath, "%s.XXXXXX", path);
+  fd = mkstemp(tmpPath);
+  if (fd < 0) {
+    free(tmpPath);
+    return 0;
+  }
+  // mkstemp() makes the file private; a cache is as readable as any file
+  mask = umask(0);
+  umask(mask);
+  fchmod(fd, 0666 & ~mask);
+  f = fdopen(fd, "wb");
+  if (f == NULL) {
+    close(fd);
+    remove(tmpPath);
+    free(tmpPath);
+    return 0;
+  }
+
+  ok = (fwrite(&header, sizeof(header), 1, f) == 1);
+  ok = ok && (fwrite(stream->values, sizeof(KplInt), stream->count, f) == (size_t) stream->count);
+  ok = ok && (fwrite(stream->offsets, sizeof(unsigned int), stream->count, f) == (size_t) stream->count);
+  ok = ok && (fwrite(stream->types, 1, stream->count, f) == (size_t) stream->count);
+  for (i = 0; ok && (i < atomCount()); i++)
+    ok = (fwrite(atomName(i), strlen(atomName(i)) + 1, 1, f) == 1);
+  ok = (fclose(f) == 0) && ok;
+
+  ok = ok && (rename(tmpPath, path) == 0);
+  if (!ok) remove(tmpPath);
+  free(tmpPath);
+  return ok;
+}
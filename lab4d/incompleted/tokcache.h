@@ -0,0 +1,41 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __TOKCACHE_H__
+#define __TOKCACHE_H__
+
+#include <stddef.h>
+#include "tokenstream.h"
+
+#define TOKEN_CACHE_MAGIC 0x3143544B  // "KTC1" read as a native int
+#define TOKEN_CACHE_VERSION 2
+#define TOKEN_CACHE_SUFFIX ".tokc"
+
+// A token cache file is a TokenCacheHeader followed by the stream's
+// values, offsets and types arrays, then the names of atoms 0..
+// atomCount-1, each NUL-terminated. It is written in the byte order of
+// the machine, which the magic number gives away, and with its KplInt,
+// whose size is recorded.
+typedef struct {
+  unsigned int magic;
+  unsigned int version;
+  unsigned long long sourceHash;
+  unsigned long long sourceLength;
+  unsigned int tokenCount;
+  unsigned int atomCount;
+  unsigned int namesSize;
+  unsigned int valueSize;
+} TokenCacheHeader;
+
+unsigned long long hashSource(const char *text, size_t length);
+
+// Both expect the global atom table to hold exactly the atoms of the
+// stream: saving right after tokenizeText() and loading before anything
+// else is interned keeps the atom ids stored in the stream valid.
+int loadTokenCache(const char *path, const char *text, size_t length, TokenStream *stream);
+int saveTokenCache(const char *path, const char *text, size_t length, TokenStream *stream);
+
+#endif
@@ -4,14 +4,28 @@
  * @version 1.0
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <string.h>
 #include "token.h"
 
-struct {
+// Keywords are found through a perfect hash on the first two characters
+// and the length of the (upper-cased) identifier: every keyword has its
+// own slot, so a lookup is one hash and at most one comparison. The
+// slots are filled from keywordList before main() runs; a keyword added
+// to the list that collides with another stops the program there, and
+// KEYWORD_HASH must then be changed.
+#define KEYWORD_HASH_SIZE 64
+#define KEYWORD_HASH(s, len) \
+  (((unsigned char) (s)[0] + 23 * (unsigned char) (s)[1] + (len)) & (KEYWORD_HASH_SIZE - 1))
+
+typedef struct {
   char string[MAX_IDENT_LEN + 1];
   TokenType tokenType;
-} keywords[KEYWORDS_COUNT] = {
+} Keyword;
+
+static const Keyword keywordList[KEYWORDS_COUNT] = {
   {"PROGRAM", KW_PROGRAM},
   {"CONST", KW_CONST},
   {"TYPE", KW_TYPE},
@@ -34,6 +48,24 @@ struct {
   {"TO", KW_TO}
 };
 
+static Keyword keywords[KEYWORD_HASH_SIZE];
+
+__attribute__((constructor)) static void hashKeywords(void) {
+  const Keyword *kw;
+  int i, h;
+
+  for (i = 0; i < KEYWORDS_COUNT; i++) {
+    kw = &keywordList[i];
+    h = KEYWORD_HASH(kw->string, strlen(kw->string));
+    if (keywords[h].tokenType != TK_NONE) {
+      fprintf(stderr, "Keywords %s and %s share slot %d of KEYWORD_HASH\n",
+              keywords[h].string, kw->string, h);
+      abort();
+    }
+    keywords[h] = *kw;
+  }
+}
+
 int keywordEq(char *kw, char *string) {
   while ((*kw != '\0') && (*string != '\0')) {
     if (*kw != *string) break;
@@ -43,10 +75,13 @@ int keywordEq(char *kw, char *string) {
 }
 
 TokenType checkKeyword(char *string) {
-  int i;
-  for (i = 0; i < KEYWORDS_COUNT; i++)
-    if (keywordEq(keywords[i].string, string)) 
-      return keywords[i].tokenType;
+  int h;
+  size_t len = strlen(string);
+
+  if (len < 2) return TK_NONE;
+  h = KEYWORD_HASH(string, len);
+  if ((keywords[h].tokenType != TK_NONE) && keywordEq(keywords[h].string, string))
+    return keywords[h].tokenType;
   return TK_NONE;
 }
 
@@ -55,6 +90,7 @@ Token* makeToken(TokenType tokenType, int lineNo, int colNo) {
   token->tokenType = tokenType;
   token->lineNo = lineNo;
   token->colNo = colNo;
+  token->offset = 0;
   return token;
 }
 
@@ -7,9 +7,23 @@
 #ifndef __TOKEN_H__
 #define __TOKEN_H__
 
+#include <limits.h>
+
 #define MAX_IDENT_LEN 15
 #define KEYWORDS_COUNT 20
 
+// Integer values, number literals included; build with -DKPL_INT64 for
+// 64-bit ones
+#ifdef KPL_INT64
+typedef long long KplInt;
+#define KPL_INT_MAX LLONG_MAX
+#define KPL_INT_FORMAT "%lld"
+#else
+typedef int KplInt;
+#define KPL_INT_MAX INT_MAX
+#define KPL_INT_FORMAT "%d"
+#endif
+
 typedef enum {
   TK_NONE, TK_IDENT, TK_NUMBER, TK_CHAR, TK_EOF,
 
@@ -26,11 +40,15 @@ typedef enum {
   SB_LPAR, SB_RPAR, SB_LSEL, SB_RSEL
 } TokenType; 
 
+// For TK_IDENT, ident is the interned name and value its atom id;
+// for TK_NUMBER, value is the number (string is not filled in).
 typedef struct {
   char string[MAX_IDENT_LEN + 1];
   int lineNo, colNo;
+  unsigned int offset;
   TokenType tokenType;
-  int value;
+  KplInt value;
+  char *ident;
 } Token;
 
 TokenType checkKeyword(char *string);
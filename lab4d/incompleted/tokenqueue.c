@@ -0,0 +1,140 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdlib.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "tokenqueue.h"
+#include "scanner.h"
+#include "atom.h"
+
+// A token as the scanner thread leaves it: like a TokenStream entry,
+// with the interned name of an identifier resolved by the scanner, as
+// the atom table is the scanner's while it runs
+typedef struct {
+  TokenType tokenType;
+  size_t offset;
+  KplInt value;
+  char *ident;
+} QueuedToken;
+
+// Single-producer single-consumer ring. head is only written by the
+// scanner and tail only by the parser; each side keeps a private copy
+// of the other's index and rereads it only when the ring looks full or
+// empty, so the two indexes are not bounced between caches on every
+// token. The indexes run freely and are masked on use.
+static QueuedToken ring[TOKEN_QUEUE_SIZE];
+
+static struct {
+  _Alignas(64) atomic_size_t head;
+  _Alignas(64) atomic_size_t tail;
+  _Alignas(64) atomic_int stop;
+} queue;
+
+static size_t producerTail;
+static size_t consumerHead;
+static size_t consumerTail;
+
+static const char *scanText;
+static size_t scanLength;
+static pthread_t scannerThread;
+static int threaded;
+
+// Returns 0 if the parser asked the scanner to stop
+static int push(QueuedToken *token, size_t head) {
+  while (head - producerTail == TOKEN_QUEUE_SIZE) {
+    producerTail = atomic_load_explicit(&queue.tail, memory_order_acquire);
+    if (head - producerTail < TOKEN_QUEUE_SIZE) break;
+    if (atomic_load_explicit(&queue.stop, memory_order_relaxed)) return 0;
+    sched_yield();
+  }
+  ring[head & (TOKEN_QUEUE_SIZE - 1)] = *token;
+  atomic_store_explicit(&queue.head, head + 1, memory_order_release);
+  return 1;
+}
+
+static void* scannerMain(void *arg) {
+  QueuedToken token;
+  Lexeme lex;
+  size_t pos = 0;
+  size_t head = 0;
+
+  do {
+    nextLexeme(scanText, scanLength, pos, &lex);
+    evaluateLexeme(scanText, &lex);
+    pos = lex.end;
+
+    if (lex.errorCode != LEX_NO_ERROR) {
+      token.tokenType = TK_NONE;
+      token.offset = lex.errorOffset;
+      token.value = lex.errorCode;
+      token.ident = NULL;
+    } else {
+      token.tokenType = lex.tokenType;
+      token.offset = lex.start;
+      token.value = lex.value;
+      token.ident = (lex.tokenType == TK_IDENT) ? atomName((int) lex.value) : NULL;
+    }
+    if (!push(&token, head ++)) break;
+  } while (lex.tokenType != TK_EOF);
+  return NULL;
+}
+
+void startScannerThread(const char *text, size_t length) {
+  scanText = text;
+  scanLength = length;
+  atomic_store(&queue.head, 0);
+  atomic_store(&queue.tail, 0);
+  atomic_store(&queue.stop, 0);
+  producerTail = 0;
+  consumerHead = 0;
+  consumerTail = 0;
+
+  // The transition table is built lazily; not from two threads at once
+  buildTransitions();
+  // Without a thread the parser scans for itself
+  threaded = (pthread_create(&scannerThread, NULL, scannerMain, NULL) == 0);
+}
+
+// Works like getValidToken(). The final TK_EOF is left in the ring and
+// returned again by later calls.
+Token* getQueuedToken(void) {
+  QueuedToken *entry;
+  Token *token;
+
+  if (!threaded)
+    return getValidToken();
+
+  while (1) {
+    while (consumerTail == consumerHead) {
+      consumerHead = atomic_load_explicit(&queue.head, memory_order_acquire);
+      if (consumerTail != consumerHead) break;
+      sched_yield();
+    }
+    entry = &ring[consumerTail & (TOKEN_QUEUE_SIZE - 1)];
+    if (entry->tokenType != TK_NONE) break;
+    errorAt((int) entry->value, entry->offset);
+    atomic_store_explicit(&queue.tail, ++ consumerTail, memory_order_release);
+  }
+
+  token = makeTokenAt(entry->tokenType, entry->offset);
+  if (entry->tokenType == TK_IDENT) {
+    token->value = entry->value;
+    token->ident = entry->ident;
+  } else setTokenValue(token, entry->value);
+
+  if (entry->tokenType != TK_EOF)
+    atomic_store_explicit(&queue.tail, ++ consumerTail, memory_order_release);
+  return token;
+}
+
+void stopScannerThread(void) {
+  atomic_store(&queue.stop, 1);
+  if (threaded)
+    pthread_join(scannerThread, NULL);
+  threaded = 0;
+}
@@ -0,0 +1,26 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __TOKENQUEUE_H__
+#define __TOKENQUEUE_H__
+
+#include <stddef.h>
+#include "token.h"
+
+// Slots in the ring between the scanner thread and the parser; a power
+// of two
+#define TOKEN_QUEUE_SIZE 4096
+
+// The scanner thread lexes the text and interns identifiers while the
+// parser runs, so nothing else may intern atoms until
+// stopScannerThread(). Lexical errors travel through the queue and are
+// reported by getQueuedToken() on the parser's side, where they would
+// be reported by getValidToken().
+void startScannerThread(const char *text, size_t length);
+Token* getQueuedToken(void);
+void stopScannerThread(void);
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "tokenstream.h"
+#include "scanner.h"
+#include "error.h"
+
+#define TOKEN_STREAM_MIN_CAPACITY 1024
+
+void initTokenStream(TokenStream *stream) {
+  stream->types = NULL;
+  stream->offsets = NULL;
+  stream->values = NULL;
+  stream->count = 0;
+  stream->capacity = 0;
+  stream->mapping = NULL;
+  stream->mappingSize = 0;
+}
+
+void freeTokenStream(TokenStream *stream) {
+  if (stream->mapping != NULL)
+    munmap(stream->mapping, stream->mappingSize);
+  else {
+    free(stream->types);
+    free(stream->offsets);
+    free(stream->values);
+  }
+  initTokenStream(stream);
+}
+
+void reserveTokens(TokenStream *stream, int capacity) {
+  if (capacity <= stream->capacity) return;
+  stream->types = (unsigned char*) realloc(stream->types, capacity * sizeof(unsigned char));
+  stream->offsets = (unsigned int*) realloc(stream->offsets, capacity * sizeof(unsigned int));
+  stream->values = (KplInt*) realloc(stream->values, capacity * sizeof(KplInt));
+  stream->capacity = capacity;
+}
+
+void appendToken(TokenStream *stream, TokenType tokenType, size_t offset, KplInt value) {
+  if (stream->count == stream->capacity)
+    reserveTokens(stream, (stream->capacity < TOKEN_STREAM_MIN_CAPACITY) ?
+                  TOKEN_STREAM_MIN_CAPACITY : 2 * stream->capacity);
+  stream->types[stream->count] = (unsigned char) tokenType;
+  stream->offsets[stream->count] = (unsigned int) offset;
+  stream->values[stream->count] = value;
+  stream->count ++;
+}
+
+// Lexical errors become TK_NONE entries, see TokenStream
+void appendLexeme(TokenStream *stream, Lexeme *lex) {
+  if (lex->errorCode != LEX_NO_ERROR)
+    appendToken(stream, TK_NONE, lex->errorOffset, lex->errorCode);
+  else
+    appendToken(stream, lex->tokenType, lex->start, lex->value);
+}
+
+void tokenizeText(TokenStream *stream, const char *text, size_t length) {
+  Lexeme lex;
+  size_t pos = 0;
+
+  // Generated sources average well over four bytes per token
+  reserveTokens(stream, stream->count + length / 4 + 1);
+  do {
+    nextLexeme(text, length, pos, &lex);
+    evaluateLexeme(text, &lex);
+    appendLexeme(stream, &lex);
+    pos = lex.end;
+  } while (lex.tokenType != TK_EOF);
+}
+
+// A stream replayed from a token cache is moved to the heap before it
+// is changed
+static void unmapTokenStream(TokenStream *stream) {
+  TokenStream copy;
+
+  if (stream->mapping == NULL) return;
+  initTokenStream(&copy);
+  reserveTokens(&copy, stream->count);
+  memcpy(copy.types, stream->types, stream->count);
+  memcpy(copy.offsets, stream->offsets, stream->count * sizeof(unsigned int));
+  memcpy(copy.values, stream->values, stream->count * sizeof(KplInt));
+  copy.count = stream->count;
+  freeTokenStream(stream);
+  *stream = copy;
+}
+
+// Whether the scanner was between lexemes at the offset of entry i, so
+// that lexing can restart there. Every entry is stored at the start of
+// its lexeme except an unterminated comment, reported at its end.
+static int isLexemeStart(TokenStream *stream, int i) {
+  return (stream->types[i] != TK_NONE) || (stream->values[i] != ERR_END_OF_COMMENT);
+}
+
+// Brings a stream of the text before an edit up to date with text, the
+// text after it: deleted bytes at offset were replaced by inserted
+// bytes, now at text + offset. Lexing restarts at the last lexeme that
+// begins before the edit, since everything up to there reads the same
+// bytes as before, and stops at the first lexeme that begins where an
+// old lexeme after the edit did (shifted by the change in size): from
+// such a point both texts are the same and so are their tokens. An edit
+// that opens or closes a comment therefore relexes up to where the
+// comment structure agrees again, possibly the end of the text.
+TokenSplice relexEdit(TokenStream *stream, const char *text, size_t length,
+                      size_t offset, size_t deleted, size_t inserted) {
+  TokenSplice splice;
+  TokenStream fresh;
+  Lexeme lex;
+  long delta = (long) inserted - (long) deleted;
+  size_t pos, oldPos;
+  int first, j, tail, i;
+  int lo, hi, mid;
+
+  unmapTokenStream(stream);
+
+  // Offsets never decrease: find the last entry before the edit
+  lo = 0;
+  hi = stream->count;
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (stream->offsets[mid] < offset) lo = mid + 1;
+    else hi = mid;
+  }
+  first = lo - 1;
+  while ((first >= 0) && !isLexemeStart(stream, first))
+    first --;
+  if (first < 0) {
+    first = 0;
+    pos = 0;
+  } else pos = stream->offsets[first];
+
+  // j walks the old lexemes that lie wholly after the edit
+  j = first;
+  while ((j < stream->count) && (stream->offsets[j] < offset + deleted))
+    j ++;
+
+  initTokenStream(&fresh);
+  while (1) {
+    nextLexeme(text, length, pos, &lex);
+    if (lex.start >= offset + inserted) {
+      oldPos = lex.start - delta;
+      while ((j < stream->count) && ((stream->offsets[j] < oldPos) || !isLexemeStart(stream, j)))
+        j ++;
+      if ((j < stream->count) && (stream->offsets[j] == oldPos))
+        break;
+    }
+    evaluateLexeme(text, &lex);
+    appendLexeme(&fresh, &lex);
+    pos = lex.end;
+    if (lex.tokenType == TK_EOF) {
+      j = stream->count;
+      break;
+    }
+  }
+
+  // Splice: old [first, j) is replaced by fresh, old [j, count) moves
+  tail = stream->count - j;
+  splice.first = first;
+  splice.removed = j - first;
+  splice.added = fresh.count;
+  reserveTokens(stream, first + fresh.count + tail);
+  memmove(stream->types + first + fresh.count, stream->types + j, tail);
+  memmove(stream->offsets + first + fresh.count, stream->offsets + j, tail * sizeof(unsigned int));
+  memmove(stream->values + first + fresh.count, stream->values + j, tail * sizeof(KplInt));
+  if (fresh.count > 0) {
+    memcpy(stream->types + first, fresh.types, fresh.count);
+    memcpy(stream->offsets + first, fresh.offsets, fresh.count * sizeof(unsigned int));
+    memcpy(stream->values + first, fresh.values, fresh.count * sizeof(KplInt));
+  }
+  stream->count = first + fresh.count + tail;
+  if (delta != 0)
+    for (i = first + fresh.count; i < stream->count; i++)
+      stream->offsets[i] += delta;
+
+  freeTokenStream(&fresh);
+  return splice;
+}
+
+// Works like getValidToken() over the stream: returns the token at
+// *index and moves *index past it, reporting the lexical errors on the
+// way. The index stays on the final TK_EOF.
+Token* getStreamToken(TokenStream *stream, int *index) {
+  int i = *index;
+  Token *token;
+
+  while (stream->types[i] == TK_NONE) {
+    errorAt((int) stream->values[i], stream->offsets[i]);
+    i ++;
+  }
+
+  token = makeTokenAt(stream->types[i], stream->offsets[i]);
+  setTokenValue(token, stream->values[i]);
+  if (stream->types[i] != TK_EOF) i ++;
+  *index = i;
+  return token;
+}
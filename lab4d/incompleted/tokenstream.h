@@ -0,0 +1,50 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __TOKENSTREAM_H__
+#define __TOKENSTREAM_H__
+
+#include <stddef.h>
+#include "token.h"
+#include "scanner.h"
+
+// A whole input lexed up front, one entry per token in parallel arrays:
+// the token type, the byte offset where it starts, and its value (the
+// number, the atom id of an identifier or the char code of a constant).
+// Lexical errors are kept as TK_NONE entries whose value is the
+// ErrorCode and whose offset is where the error is reported. The last
+// entry is always TK_EOF. Offsets are 32-bit, so inputs are limited to 4 GB.
+// A stream replayed from a token cache is read-only: its arrays live in
+// the mapping of the cache file.
+typedef struct {
+  unsigned char *types;
+  unsigned int *offsets;
+  KplInt *values;
+  int count;
+  int capacity;
+  void *mapping;
+  size_t mappingSize;
+} TokenStream;
+
+// The entries an edit replaced: [first, first + removed) of the old
+// stream became [first, first + added) of the new one
+typedef struct {
+  int first;
+  int removed;
+  int added;
+} TokenSplice;
+
+void initTokenStream(TokenStream *stream);
+void freeTokenStream(TokenStream *stream);
+void reserveTokens(TokenStream *stream, int capacity);
+void appendToken(TokenStream *stream, TokenType tokenType, size_t offset, KplInt value);
+void appendLexeme(TokenStream *stream, Lexeme *lex);
+void tokenizeText(TokenStream *stream, const char *text, size_t length);
+TokenSplice relexEdit(TokenStream *stream, const char *text, size_t length,
+                      size_t offset, size_t deleted, size_t inserted);
+Token* getStreamToken(TokenStream *stream, int *index);
+
+#endif